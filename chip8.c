@@ -1,11 +1,18 @@
 /* José Guilherme de C. Rodrigues - 03/2020 */
 #include "chip8.h"
+#include "chip8_log.h"
+#include "chip8_fusion.h"
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 /* 
 TODO: Some instructions were different in a few sites, for those, it would be a good idea to add a flag
       to select a version to use when executing the code.
@@ -31,48 +38,142 @@ uint8_t chip8_characters[0x50] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// Every instance gets a different seed, even when many are created within the same second.
+static atomic_uint_fast32_t seed_counter;
+
+static chip8 *allocate_chip8() {
+#ifdef _WIN32
+	return _aligned_malloc(sizeof(chip8), CHIP8_ALIGNMENT);
+#else
+	// sizeof(chip8) is a multiple of the alignment, as aligned_alloc wants.
+	return aligned_alloc(CHIP8_ALIGNMENT, sizeof(chip8));
+#endif
+}
+
+static void free_chip8(chip8 *c) {
+#ifdef _WIN32
+	_aligned_free(c);
+#else
+	free(c);
+#endif
+}
+
+uint32_t chip8_random_seed() {
+	uint32_t count = atomic_fetch_add(&seed_counter, 1);
+	// xorshift can't start from 0.
+	return (((uint32_t) time(NULL) ^ (count * 0x9E3779B9)) * 0x85EBCA6B) | 0x1;
+}
+
 chip8 *create_chip8(bool debug) {
-	chip8 *c = malloc(sizeof(chip8));
+	chip8 *c = allocate_chip8();
+	if (!c)
+		return NULL;
 
 	c->opcode = 0x0000;
 	memset(c->memory, 0x00, sizeof(c->memory));
 
 	// Place the characters in memory.
-	for (size_t s = 0; s < sizeof(chip8_characters); ++s)
-		c->memory[s] = chip8_characters[s];
-
-	memset(c->regs.v, 0x00, sizeof(c->regs.v));
+	memcpy(c->memory, chip8_characters, sizeof(chip8_characters));
 
-	c->regs.i = 0x0000;
-	c->regs.sound_timer = 0x00;
-	c->regs.delay_timer = 0x00;
+	memset(&c->regs, 0x00, sizeof(c->regs));
 	c->regs.pc = 0x0200;
-	c->regs.sp = 0x00;
 
 	memset(c->stack, 0x0000, sizeof(c->stack));
-	
-	for (uint8_t y = 0; y < DISPLAY_HEIGHT; ++y)
-		for (uint8_t x = 0; x < DISPLAY_WIDTH; ++x)
-			c->display[y][x] = 0;
-
+	memset(c->display, 0x00, sizeof(c->display));
 	memset(c->keyboard, false, sizeof(c->keyboard));
+
 	c->status.need_redraw = false;
 	c->status.need_sound = false;
 	c->status.need_keystroke = false;
 	c->status.debug = debug;
+	c->status.fault = FAULT_NONE;
+	c->dirty = 0;
+	c->cache = NULL;
+	c->host = NULL;
+	c->pool = NULL;
+	c->release = NULL;
+	c->origin = NULL;
 
 	// We should also initialize the random number generator with a random seed.
 	// CHIP8 uses in one of it's instruction.
-	srand(time(NULL));
+	c->rng = chip8_random_seed();
+
+	rehash_memory(c);
+	c->display_hash = 0;
 
 	return c;
 }
 
-void delete_chip8(chip8 *chip8) {
-	if (chip8) {
-		free(chip8);
-		chip8 = NULL;
+chip8 *chip8_clone(const chip8 *original) {
+	chip8 *c = allocate_chip8();
+
+	if (c) {
+		memcpy(c, original, sizeof(chip8));
+		// The cache follows the original's memory, not the clone's, and the host's frame count it's run.
+		c->cache = NULL;
+		c->host = NULL;
+		c->pool = NULL;
+		c->release = NULL;
+	}
+
+	return c;
+}
+
+void chip8_restore(chip8 *destination, const chip8 *snapshot) {
+	// Each instance keeps it's own cache, and it no longer matches the memory.
+	struct decode_cache *cache = destination->cache;
+	struct chip8_host *host = destination->host;
+	struct chip8_pool *pool = destination->pool;
+	void (*release)(chip8 *) = destination->release;
+	memcpy(destination, snapshot, sizeof(*destination));
+	destination->dirty = 0;
+	destination->cache = cache;
+	destination->host = host;
+	destination->pool = pool;
+	destination->release = release;
+	destination->origin = snapshot;
+	if (cache)
+		flush_decode_cache(cache);
+}
+
+void chip8_reset_dirty(chip8 *destination, const chip8 *snapshot) {
+	for (uint32_t dirty = destination->dirty & 0xFFFF; dirty != 0; dirty &= dirty - 1) {
+		uint16_t page = __builtin_ctz(dirty) * PAGE_SIZE;
+		memcpy(destination->memory + page, snapshot->memory + page, PAGE_SIZE);
+		if (destination->cache)
+			invalidate_decode_cache(destination->cache, page, PAGE_SIZE);
 	}
+
+	if (destination->dirty & DIRTY_DISPLAY)
+		memcpy(destination->display, snapshot->display, sizeof(destination->display));
+
+	// Everything else is small enough to always be copied.
+	destination->opcode = snapshot->opcode;
+	destination->regs = snapshot->regs;
+	memcpy(destination->stack, snapshot->stack, sizeof(destination->stack));
+	memcpy(destination->keyboard, snapshot->keyboard, sizeof(destination->keyboard));
+	destination->status = snapshot->status;
+	destination->rng = snapshot->rng;
+	destination->memory_hash = snapshot->memory_hash;
+	destination->display_hash = snapshot->display_hash;
+	destination->dirty = 0;
+}
+
+void chip8_reset(chip8 *destination, const chip8 *snapshot) {
+	if (destination->origin == snapshot)
+		chip8_reset_dirty(destination, snapshot);
+	else
+		chip8_restore(destination, snapshot);
+}
+
+void delete_chip8(chip8 *chip8) {
+	if (!chip8)
+		return;
+
+	if (chip8->release)
+		chip8->release(chip8);
+	else
+		free_chip8(chip8);
 }
 
 bool load_program(chip8 *chip8, const char *filename) {
@@ -80,21 +181,17 @@ bool load_program(chip8 *chip8, const char *filename) {
 
 	FILE *file = fopen(filename, "rb");
 	if (file) {
-		// Get file size.
-		fseek(file, 0, SEEK_END);
-		long size = ftell(file);
-		fseek(file, 0, SEEK_SET);
+		uint8_t program[sizeof(chip8->memory) - 0x200];
 
-		// If it can fit in the program memory.
-		if (size <= sizeof(chip8->memory) - 0x200) {		
-			fread(chip8->memory + 0x200, sizeof(uint8_t), size, file);
+		// Reading one byte more than fits tells if the file is too big.
+		size_t size = fread(program, sizeof(uint8_t), sizeof(program), file);
+		if (fgetc(file) == EOF) {
+			success = load_program_data(chip8, program, size);
 
-			if(chip8->status.debug) {
-				printf("Loaded program!\n");
+			if(success && chip8->status.debug) {
+				log_text("Loaded program!\n");
 				print_memory_in_range(chip8, 0x200, 0x200 + size);
 			}
-
-			success = true;
 		} else {
 			printf("\"%s\" is not a valid chip8 program.", filename);
 		}
@@ -105,8 +202,21 @@ bool load_program(chip8 *chip8, const char *filename) {
 	return success;
 }
 
+bool load_program_data(chip8 *chip8, const uint8_t *data, size_t size) {
+	// If it can fit in the program memory.
+	if (size > sizeof(chip8->memory) - 0x200)
+		return false;
+
+	// Byte by byte so the memory hash and the dirty pages stay up to date.
+	for (size_t u = 0; u < size; ++u)
+		write_memory(chip8, 0x200 + u, data[u]);
+
+	return true;
+}
+
 bool check_key(chip8 *chip8, uint8_t key) {
-	return chip8->keyboard[key];
+	// Vx can hold any byte, only the low nibble is a key.
+	return chip8->keyboard[key & 0xF];
 }
 
 void change_key(chip8 *chip8, uint8_t key, bool active) {
@@ -123,33 +233,201 @@ void change_key(chip8 *chip8, uint8_t key, bool active) {
 	}
 }
 
+// Finalizer of splitmix64, spreads every input bit over the whole output.
+static uint64_t mix_hash(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// Each (address, value) and each lit pixel has it's own key. The hashes are the XOR of
+// every key, so a write only has to take the old key out and put the new one in.
+#define MEMORY_KEY(address, value) mix_hash(((uint64_t) (address) << 8) | (value))
+#define PIXEL_KEY(x, y) mix_hash(0x100000 + (y) * DISPLAY_WIDTH + (x))
+
+void write_memory(chip8 *chip8, uint16_t address, uint8_t value) {
+	chip8->memory_hash ^= MEMORY_KEY(address, chip8->memory[address]) ^ MEMORY_KEY(address, value);
+	chip8->memory[address] = value;
+	chip8->dirty |= 1 << (address / PAGE_SIZE);
+	if (chip8->cache)
+		invalidate_decode_cache(chip8->cache, address, 1);
+}
+
+// Instructions that go through I must not leave memory, whatever the program puts in it.
+static bool check_memory_range(chip8 *chip8, uint16_t length) {
+	if (chip8->regs.i + length > sizeof(chip8->memory)) {
+		chip8->status.fault = FAULT_MEMORY;
+		return false;
+	}
+
+	return true;
+}
+
+void rehash_memory(chip8 *chip8) {
+	chip8->memory_hash = 0;
+	for (uint16_t u = 0; u < sizeof(chip8->memory); ++u)
+		chip8->memory_hash ^= MEMORY_KEY(u, chip8->memory[u]);
+}
+
+uint64_t chip8_state_hash(const chip8 *chip8) {
+	uint64_t h = mix_hash(chip8->memory_hash ^ mix_hash(chip8->display_hash));
+	uint64_t word;
+
+	// The registers are few, folding them in 8 bytes at a time is cheaper than keeping them hashed.
+	for (uint8_t u = 0; u < sizeof(chip8->regs.v); u += sizeof(word)) {
+		memcpy(&word, chip8->regs.v + u, sizeof(word));
+		h = mix_hash(h ^ word);
+	}
+
+	word = chip8->regs.i | (uint64_t) chip8->regs.pc << 16 | (uint64_t) chip8->regs.sp << 32
+		| (uint64_t) chip8->regs.delay_timer << 40 | (uint64_t) chip8->regs.sound_timer << 48;
+	h = mix_hash(h ^ word);
+
+	for (uint8_t u = 0; u < 0x10; u += 4) {
+		word = chip8->stack[u] | (uint64_t) chip8->stack[u + 1] << 16 | (uint64_t) chip8->stack[u + 2] << 32 | (uint64_t) chip8->stack[u + 3] << 48;
+		h = mix_hash(h ^ word);
+	}
+
+	// While waiting for a keystroke, the opcode tells which register will receive the key.
+	word = chip8->rng | (uint64_t) (chip8->status.need_keystroke ? 0x10000 | chip8->opcode : 0) << 32;
+	return mix_hash(h ^ word);
+}
+
 void tick(chip8 *chip8) {
-	if (chip8) {
-		// Fetch
-		fetch_instruction(chip8);
-
-		// Decode
-		infn_ptr instruction = decode_instruction(chip8);
-
-		// Execute
-		if (instruction)
-			(*instruction)(chip8);
-		
-		// Update timers
-		if (chip8->regs.delay_timer != 0)
-			--chip8->regs.delay_timer;
-
-		if (chip8->regs.sound_timer != 0) {
-			// Play sound
-			chip8->status.need_sound = true;
-			--chip8->regs.sound_timer;
+	if (chip8 && !chip8->status.fault) {
+		step(chip8);
+		update_timers(chip8);
+	}
+}
+
+void init_host(chip8_host *host) {
+	memset(host, 0, sizeof(*host));
+	host->stop = RUN_EVENT(RUN_BREAKPOINT);
+}
+
+void set_breakpoint(chip8_host *host, uint16_t address, bool active) {
+	address &= 0x0FFF;
+	if (active)
+		host->breakpoints[address >> 3] |= 1 << (address & 0x7);
+	else
+		host->breakpoints[address >> 3] &= ~(1 << (address & 0x7));
+}
+
+// Tells the host about event. Every event is reported, but only the first one that stops is the reason.
+static void report_event(chip8 *chip8, chip8_event callback, chip8_exit event, bool *stop, chip8_exit *reason) {
+	bool stops = callback ? callback(chip8, chip8->host->user) : (chip8->host->stop & RUN_EVENT(event)) != 0;
+	if (stops && !*stop) {
+		*stop = true;
+		*reason = event;
+	}
+}
+
+uint32_t chip8_run(chip8 *chip8, uint32_t max_cycles, chip8_exit *exit_reason) {
+	chip8_host *host = chip8->host;
+	chip8_exit reason = RUN_BUDGET;
+	bool stop = false;
+	uint32_t cycles = 0;
+
+	while (!stop) {
+		if (chip8->status.fault) {
+			reason = RUN_FAULT;
+			break;
+		}
+
+		// The host may give the key right away, otherwise there's nothing else to run.
+		if (chip8->status.need_keystroke) {
+			if (host && host->on_key_wait)
+				stop = host->on_key_wait(chip8, host->user);
+
+			if (stop || chip8->status.need_keystroke) {
+				reason = RUN_KEY_WAIT;
+				break;
+			}
+		}
+
+		if (cycles == max_cycles)
+			break;
+
+		uint16_t pc = chip8->regs.pc & 0x0FFF;
+		if (host && (host->breakpoints[pc >> 3] >> (pc & 0x7)) & 0x1 && !(cycles == 0 && host->resume && pc == host->resume_pc)) {
+			report_event(chip8, host->on_breakpoint, RUN_BREAKPOINT, &stop, &reason);
+			if (stop) {
+				// The next call continues from here instead of stopping again.
+				host->resume = reason == RUN_BREAKPOINT;
+				host->resume_pc = pc;
+				break;
+			}
+		}
+
+		// Only the first instruction of a call may be the one it stopped at.
+		if (host && cycles == 0)
+			host->resume = false;
+
+		uint64_t display_hash = chip8->display_hash;
+		bool sound = chip8->regs.sound_timer != 0;
+
+		step(chip8);
+		update_timers(chip8);
+		++cycles;
+
+		if (!host)
+			continue;
+
+		chip8->status.need_redraw = false;
+		chip8->status.need_sound = false;
+
+		if (chip8->display_hash != display_hash)
+			report_event(chip8, host->on_display, RUN_DISPLAY, &stop, &reason);
+
+		if ((chip8->regs.sound_timer != 0) != sound)
+			report_event(chip8, host->on_sound, RUN_SOUND, &stop, &reason);
+
+		if (host->cycles_per_frame && ++host->frame_cycles >= host->cycles_per_frame) {
+			host->frame_cycles = 0;
+			report_event(chip8, host->on_frame, RUN_FRAME, &stop, &reason);
 		}
 	}
+
+	if (exit_reason)
+		*exit_reason = reason;
+
+	return cycles;
+}
+
+void step(chip8 *chip8) {
+	// Fetch
+	fetch_instruction(chip8);
+
+	// Decode
+	infn_ptr instruction = decode_instruction(chip8);
+
+	// Execute
+	if (instruction && !chip8->status.fault)
+		(*instruction)(chip8);
+}
+
+void update_timers(chip8 *chip8) {
+	if (chip8->regs.delay_timer != 0)
+		--chip8->regs.delay_timer;
+
+	if (chip8->regs.sound_timer != 0) {
+		// Play sound
+		chip8->status.need_sound = true;
+		--chip8->regs.sound_timer;
+	}
 }
 
 void fetch_instruction(chip8 *chip8) {
 	// All instructions are 2 byte long and the most significant byte is stored first.
 	chip8->opcode = 0x0000;
+	if (chip8->regs.pc >= sizeof(chip8->memory) - 1) {
+		chip8->status.fault = FAULT_PC;
+		return;
+	}
+
 	// Fetch the instruction (the first part and shift 8 bytes left and then the second part) and put it
 	// in the opcode.
 	chip8->opcode = (chip8->memory[chip8->regs.pc] << 8);
@@ -249,11 +527,19 @@ INFN(cls) {
 	DEBUG_INSTRUCTION_LOG("cls");
 	// 00E0: Clears the screen.
 	memset(chip8->display, 0x0, sizeof(chip8->display));
+	chip8->display_hash = 0;
+	chip8->dirty |= DIRTY_DISPLAY;
 }
 
 INFN(ret) {
 	DEBUG_INSTRUCTION_LOG("ret");
 	// 00EE: Return from subroutine.
+	// The first level of the stack is never used, sp 0 means there's nothing to return to.
+	if (chip8->regs.sp == 0) {
+		chip8->status.fault = FAULT_STACK_UNDERFLOW;
+		return;
+	}
+
 	chip8->regs.pc = chip8->stack[chip8->regs.sp--];
 }
 
@@ -268,6 +554,11 @@ INFN(call_addr) {
 	DEBUG_INSTRUCTION_LOG("call_addr");
 	// 2nnn: Call subroutine at nnn.
 	// SHOULD THE FUNCTION BE ABLE TO JUMP TO MEMORY LOWER THAN 0x200?
+	if (chip8->regs.sp == 0xF) {
+		chip8->status.fault = FAULT_STACK_OVERFLOW;
+		return;
+	}
+
 	chip8->stack[++chip8->regs.sp] = chip8->regs.pc;
 	chip8->regs.pc = chip8->opcode & 0x0FFF;
 }
@@ -381,7 +672,7 @@ INFN(shl_vx_vy) {
 INFN(sne_vx_vy) {
 	DEBUG_INSTRUCTION_LOG("sne_vx_vy");
 	// 9xy0: Skip next instruction if Vx != Vy.
-	if (chip8->regs.v[HB_LN(chip8->opcode)] != chip8->regs.v[LB(chip8->opcode)])
+	if (chip8->regs.v[HB_LN(chip8->opcode)] != chip8->regs.v[LB_HN(chip8->opcode)])
 		chip8->regs.pc += 2;
 }
 
@@ -400,7 +691,11 @@ INFN(jp_v0_addr) {
 INFN(rnd_vx_byte) {
 	DEBUG_INSTRUCTION_LOG("rnd_vx_byte");
 	// Cxkk: random byte (0 - 255) and kk
-	chip8->regs.v[HB_LN(chip8->opcode)] = (rand() % 256) & LB(chip8->opcode);
+	// xorshift32, so every instance (and every clone of it) has it's own sequence.
+	chip8->rng ^= chip8->rng << 13;
+	chip8->rng ^= chip8->rng >> 17;
+	chip8->rng ^= chip8->rng << 5;
+	chip8->regs.v[HB_LN(chip8->opcode)] = (chip8->rng & 0xFF) & LB(chip8->opcode);
 }
 
 INFN(drw_vx_vy_nibble) {
@@ -408,6 +703,8 @@ INFN(drw_vx_vy_nibble) {
 	// Dxyn: Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = Collision.
 	// All sprites are 8xn pixels in size, where n can go up to 15.
 	uint8_t vx = chip8->regs.v[HB_LN(chip8->opcode)], vy = chip8->regs.v[LB_HN(chip8->opcode)], n = LB_LN(chip8->opcode);
+	if (!check_memory_range(chip8, n))
+		return;
 	
 	for (uint16_t y = 0; y < n; ++y) {
 		uint8_t sprite = chip8->memory[chip8->regs.i + y];
@@ -415,10 +712,13 @@ INFN(drw_vx_vy_nibble) {
 			if (chip8->display[(vy + y) % DISPLAY_HEIGHT][(vx + x) % DISPLAY_WIDTH] == 1 && ((sprite >> (7 - x)) & 0x01) == 1)
 				chip8->regs.v[0xF] = 1;
 			chip8->display[(vy + y) % DISPLAY_HEIGHT][(vx + x) % DISPLAY_WIDTH] ^= ((sprite >> (7 - x)) & 0x01);
+			if ((sprite >> (7 - x)) & 0x01)
+				chip8->display_hash ^= PIXEL_KEY((vx + x) % DISPLAY_WIDTH, (vy + y) % DISPLAY_HEIGHT);
 		}
 	}
 
 	chip8->status.need_redraw = true;
+	chip8->dirty |= DIRTY_DISPLAY;
 }
 
 INFN(skp_vx) {
@@ -479,9 +779,12 @@ INFN(ld_b_vx) {
 	DEBUG_INSTRUCTION_LOG("ld_b_vx");
 	// Fx33: Store BCD rep. of digit in Vx in memory locations I, I + 1, and I +2.
 	uint8_t vx_value = chip8->regs.v[HB_LN(chip8->opcode)];
-	chip8->memory[chip8->regs.i] = vx_value / 100;
-	chip8->memory[chip8->regs.i + 1] = floor((vx_value % 100) / 10);
-	chip8->memory[chip8->regs.i + 2] = vx_value % 10;
+	if (!check_memory_range(chip8, 3))
+		return;
+
+	write_memory(chip8, chip8->regs.i, vx_value / 100);
+	write_memory(chip8, chip8->regs.i + 1, floor((vx_value % 100) / 10));
+	write_memory(chip8, chip8->regs.i + 2, vx_value % 10);
 }
 
 INFN(ld_at_i_vx) {
@@ -489,8 +792,11 @@ INFN(ld_at_i_vx) {
 	// Fx55: Store registers V0 through Vx in memory starting at location I.
 	// I is set to I + X + 1 after the operation.
 	uint8_t x = HB_LN(chip8->opcode);
+	if (!check_memory_range(chip8, x + 1))
+		return;
+
 	for (uint8_t u = 0; u <= x; ++u)
-		chip8->memory[chip8->regs.i + u] = chip8->regs.v[u];
+		write_memory(chip8, chip8->regs.i + u, chip8->regs.v[u]);
 	chip8->regs.i += x + 1;
 }
 
@@ -499,51 +805,41 @@ INFN(ld_vx_at_i) {
 	// Fx65: Read registers V0 through Vx from memory starting at location I.
 	// I is set to I + X + 1 after operation.
 	uint8_t x = HB_LN(chip8->opcode);
+	if (!check_memory_range(chip8, x + 1))
+		return;
+
 	for (uint8_t u = 0; u <= x; ++u)
 		chip8->regs.v[u] = chip8->memory[chip8->regs.i + u];
 	chip8->regs.i += x + 1;
 }
 
 // Functions that print the component's state.
+// They go through the log, so they don't hold the interpreter while the console catches up.
 void print_registers(chip8 *chip8) {
-	if (chip8) {
-		for (uint8_t u = 0; u < 0x10; ++u) {
-			if (u % 8 == 0)
-				printf("\n");
-
-			printf("V[%u]: 0x%X ", u, chip8->regs.v[u]);
-		}
-
-		printf(
-			"\nI: 0x%X"
-			"\tSoundTimer: %u"
-			"\tDelayTimer: %u"
-			"\tPC: %u"
-			"\tSP: %u\n",
-			chip8->regs.i, chip8->regs.sound_timer, chip8->regs.delay_timer, chip8->regs.pc, chip8->regs.sp
-		);
-	}
+	if (chip8)
+		log_registers(&chip8->regs);
 }
 
 void print_memory_in_range(chip8 *chip8, uint16_t start, uint16_t end) {
 	if (chip8) {
-		printf("Memory in range [%u, %u]", start, end);
-		for (uint16_t u = start; u < end; ++u) {
-			if (u % 8 == 0)
-				printf("\n[%u/0x%X]", u, u);
-
-			printf("\t0x%X", chip8->memory[u]);
+		if (end > sizeof(chip8->memory))
+			end = sizeof(chip8->memory);
+
+		log_text("Memory in range [%u, %u]", start, end);
+		// One record for each line of 8 bytes.
+		for (uint16_t u = start; u < end;) {
+			uint16_t length = 8 - u % 8;
+			if (u + length > end)
+				length = end - u;
+
+			log_memory(u, chip8->memory + u, length);
+			u += length;
 		}
-		printf("\n");
+		log_text("\n");
 	}
 }
 
 void print_keyboard(chip8 *chip8) {
-	if (chip8) { 
-		static char keys[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-		for (uint8_t u = 0; u < 0x10; ++u) {
-			printf("[%c]: %u ", keys[u], chip8->keyboard[u]);
-		}
-		printf("\n");
-	}
-}
\ No newline at end of file
+	if (chip8)
+		log_keyboard(chip8->keyboard);
+}
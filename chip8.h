@@ -4,9 +4,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
+// x only documents the instruction, the log finds the name again from the opcode (see chip8_log.h).
 #define DEBUG_INSTRUCTION_LOG(x) if (chip8->status.debug) \
-					printf("[CHIP8 - DEBUG] " x " 0x%X\n", chip8->opcode)
+					log_instruction(chip8->regs.pc - 2, chip8->opcode)
 
 // Some macros to make 2 byte variables manipulation easier.
 #define HB_HN(x) (x & 0xF000) >> 12	// HIGH BYTE HIGH NIBBLE
@@ -36,11 +38,41 @@
 #define DISPLAY_WIDTH 0x40
 #define DISPLAY_HEIGHT 0x20
 
+// Set in status.fault when a program does something that would take the interpreter out of it's own memory.
+// The instruction isn't executed and the chip8 stops ticking until it's reset.
+typedef enum {
+	FAULT_NONE = 0,
+	FAULT_STACK_OVERFLOW,	// call_addr with every level of the stack in use.
+	FAULT_STACK_UNDERFLOW,	// ret without a call to return from.
+	FAULT_MEMORY,		// I + offset past the end of memory.
+	FAULT_PC		// Program counter past the end of memory.
+} chip8_fault;
+
+// Memory is tracked in pages, so a reset only has to copy back the ones written to.
+#define PAGE_SIZE 0x100
+#define DIRTY_DISPLAY (1 << 16)	// Bits 0 to 15 are the memory pages.
+
+// Why chip8_run returned.
+typedef enum {
+	RUN_BUDGET = 0,		// max_cycles were executed.
+	RUN_FRAME,		// host->cycles_per_frame cycles since the last frame boundary.
+	RUN_DISPLAY,		// The display changed (drawing without changing any pixel doesn't count).
+	RUN_SOUND,		// The sound timer started or stopped, sound_timer tells which.
+	RUN_KEY_WAIT,		// Fx0A is waiting for a key.
+	RUN_BREAKPOINT,		// PC is at a breakpoint, the instruction there wasn't executed yet.
+	RUN_FAULT		// status.fault was set.
+} chip8_exit;
+
+#define RUN_EVENT(x) (1 << (x))
+
+struct chip8_host;
+
 typedef struct {
 	bool need_redraw;
 	bool need_sound;
 	bool need_keystroke;
 	bool debug;
+	uint8_t fault;
 } chip8_status;
 
 typedef struct {
@@ -52,16 +84,53 @@ typedef struct {
 	uint8_t	sp;		// Stack pointer (topmost level of the stack).
 } chip8_regs;
 
-typedef struct {
+// Instances are aligned to cache lines, so the hot fields below never straddle one they don't need.
+#define CHIP8_ALIGNMENT 64
+
+struct chip8_pool;
+
+// Ordered by how often it's touched: the fields every instruction uses share the first cache lines,
+// memory and display, which are only read or written in small parts, come after on their own lines.
+typedef struct chip8 {
 	uint16_t opcode;
-	uint8_t memory[0x1000];					// 4096 Bytes of memory. (4KB)
 	chip8_regs regs;
 	uint16_t stack[0x10];					// 16 16-bit levels of stack (used to store addresses to return when coming back from subroutines).
-	uint8_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH]; 	// 64x32 pixel monochrome display.
-	bool keyboard[0x10];					// 16 key keyboard each part position indicates a key state.
 	chip8_status status;
+	uint32_t rng;						// Random number generator state (each instance has it's own, so clones stay deterministic).
+	uint32_t dirty;						// Pages (and display) changed since the last restore.
+	uint64_t memory_hash;					// Incremental hashes of memory and display, kept up to date on every write.
+	uint64_t display_hash;
+	struct decode_cache *cache;				// Optional, see chip8_fusion.h. Each instance needs it's own.
+	struct chip8_host *host;				// Optional, see chip8_run. Each instance needs it's own.
+	struct chip8_pool *pool;				// Pool the instance came from, NULL if it was allocated on it's own.
+	void (*release)(struct chip8 *chip8);			// Called by delete_chip8 instead of freeing, when set (see chip8_pool.h).
+	const struct chip8 *origin;				// Snapshot last restored from, see chip8_reset.
+	bool keyboard[0x10];					// 16 key keyboard each part position indicates a key state.
+	_Alignas(CHIP8_ALIGNMENT) uint8_t memory[0x1000];	// 4096 Bytes of memory. (4KB)
+	uint8_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH]; 	// 64x32 pixel monochrome display.
 } chip8;
 
+// Called by chip8_run when an event happens, returning true makes chip8_run return with that event.
+typedef bool(*chip8_event)(chip8 *chip8, void *user);
+
+// What a host embedding the chip8 wants to hear about. An event with a callback asks it whether to stop,
+// one without stops chip8_run if it's in stop. Key waits and faults always stop unless handled
+// (a key wait is handled by calling change_key from on_key_wait).
+typedef struct chip8_host {
+	chip8_event on_frame;
+	chip8_event on_display;
+	chip8_event on_sound;
+	chip8_event on_key_wait;
+	chip8_event on_breakpoint;
+	void *user;				// Given to every callback.
+	uint32_t stop;				// RUN_EVENT(x) of the events that stop without a callback.
+	uint32_t cycles_per_frame;		// 0 for no frame boundaries.
+	uint32_t frame_cycles;			// Cycles since the last frame boundary.
+	uint8_t breakpoints[0x1000 / 8];	// One bit per address, see set_breakpoint.
+	bool resume;				// chip8_run last stopped at the breakpoint at resume_pc.
+	uint16_t resume_pc;
+} chip8_host;
+
 // Default CHIP8 sprites. Should be store from (0x000 to 0x1FF)
 extern uint8_t chip8_characters[0x50];
 // Memory from 0x000 to 0x1FF is reserved for interpreter.
@@ -75,12 +144,42 @@ typedef void(*infn_ptr)(chip8 *);
 #define INFN(x) void x(chip8 *chip8)
 
 chip8 *create_chip8(bool debug);
+// A seed for chip8.rng that differs on every call, what create_chip8 uses.
+uint32_t chip8_random_seed();
 void delete_chip8(chip8 *chip8);
 bool load_program(chip8 *chip8, const char *filename);
+bool load_program_data(chip8 *chip8, const uint8_t *data, size_t size);
 bool check_key(chip8 *chip8, uint8_t key);
 void change_key(chip8 *chip8, uint8_t key, bool active);
 
+// Snapshots. A clone is a full copy that can be run independently from the original.
+chip8 *chip8_clone(const chip8 *chip8);
+void chip8_restore(chip8 *destination, const chip8 *snapshot);
+// Same as chip8_restore, but only copies the pages and display written to since destination
+// was last restored from the same snapshot.
+void chip8_reset_dirty(chip8 *destination, const chip8 *snapshot);
+// Makes destination a copy of snapshot again: only the dirty pages if it was last restored or reset from
+// it, everything otherwise. Keeps destination's cache, host and pool. The snapshot must not change while
+// instances are reset from it, and must outlive them (another one at the same address would be taken for it).
+void chip8_reset(chip8 *destination, const chip8 *snapshot);
+
+// Hashing. Memory and display are hashed incrementally as they're written to,
+// so hashing the whole state only has to go through the registers and the stack.
+void write_memory(chip8 *chip8, uint16_t address, uint8_t value);
+void rehash_memory(chip8 *chip8);
+uint64_t chip8_state_hash(const chip8 *chip8);
+
 void tick(chip8 *chip8); //  A tick will go through every step needed in a cycle.
+// Ticks until max_cycles were executed or an event stops it (see chip8_host), without a round trip to
+// the caller per instruction. need_redraw and need_sound are cleared, the events take their place.
+// After stopping at a breakpoint, calling it again from the same PC runs that instruction instead of
+// stopping again. Any other call stops at a breakpoint before its first instruction, including at the PC it starts from.
+// Returns how many cycles were executed, exit_reason (may be NULL) tells why it returned.
+uint32_t chip8_run(chip8 *chip8, uint32_t max_cycles, chip8_exit *exit_reason);
+void init_host(chip8_host *host);
+void set_breakpoint(chip8_host *host, uint16_t address, bool active);
+void step(chip8 *chip8); // Fetches, decodes and executes a single instruction, without touching the timers.
+void update_timers(chip8 *chip8);
 void fetch_instruction(chip8 *chip8);
 infn_ptr decode_instruction(chip8 *chip8);
 
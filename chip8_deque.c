@@ -0,0 +1,78 @@
+#include "chip8_deque.h"
+#include <stdlib.h>
+
+bool deque_init(work_deque *deque, size_t capacity) {
+	// Round up to a power of two so indexes can wrap with a mask.
+	size_t c = 16;
+	while (c < capacity)
+		c <<= 1;
+
+	deque->items = malloc(sizeof(void *) * c);
+	deque->capacity = c;
+	deque->top = 0;
+	deque->bottom = 0;
+
+	return deque->items && pthread_mutex_init(&deque->lock, NULL) == 0;
+}
+
+void deque_destroy(work_deque *deque) {
+	free(deque->items);
+	deque->items = NULL;
+	pthread_mutex_destroy(&deque->lock);
+}
+
+bool deque_push(work_deque *deque, void *item) {
+	bool success = true;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom - deque->top == deque->capacity) {
+		// Full, move everything to a buffer twice the size keeping the order.
+		void **items = malloc(sizeof(void *) * deque->capacity * 2);
+		if (items) {
+			for (size_t u = deque->top; u != deque->bottom; ++u)
+				items[u & (deque->capacity * 2 - 1)] = deque->items[u & (deque->capacity - 1)];
+
+			free(deque->items);
+			deque->items = items;
+			deque->capacity *= 2;
+		} else {
+			success = false;
+		}
+	}
+
+	if (success)
+		deque->items[deque->bottom++ & (deque->capacity - 1)] = item;
+	pthread_mutex_unlock(&deque->lock);
+
+	return success;
+}
+
+void *deque_pop(work_deque *deque) {
+	void *item = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top)
+		item = deque->items[--deque->bottom & (deque->capacity - 1)];
+	pthread_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+void *deque_steal(work_deque *deque) {
+	void *item = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top)
+		item = deque->items[deque->top++ & (deque->capacity - 1)];
+	pthread_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+size_t deque_size(work_deque *deque) {
+	pthread_mutex_lock(&deque->lock);
+	size_t size = deque->bottom - deque->top;
+	pthread_mutex_unlock(&deque->lock);
+
+	return size;
+}
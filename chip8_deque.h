@@ -0,0 +1,25 @@
+#ifndef __CHIP8_DEQUE_H__
+#define __CHIP8_DEQUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Work stealing deque. The owner pushes and pops at the bottom (newest work first),
+// other threads steal from the top (oldest work first), so they rarely fight over the same end.
+typedef struct {
+	void **items;
+	size_t capacity;	// Always a power of two.
+	size_t top;		// Index of the oldest item.
+	size_t bottom;		// Index after the newest item.
+	pthread_mutex_t lock;
+} work_deque;
+
+bool deque_init(work_deque *deque, size_t capacity);
+void deque_destroy(work_deque *deque);
+bool deque_push(work_deque *deque, void *item);
+void *deque_pop(work_deque *deque);
+void *deque_steal(work_deque *deque);
+size_t deque_size(work_deque *deque);
+
+#endif
@@ -0,0 +1,527 @@
+#include "chip8_explorer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPLAY_SIZE (DISPLAY_WIDTH * DISPLAY_HEIGHT)
+
+typedef struct {
+	explorer *ex;
+	uint32_t id;
+} explorer_thread;
+
+static bool goal_pc(const chip8 *chip8, void *data) {
+	return chip8->regs.pc == *(uint16_t *) data;
+}
+
+int main(int argc, char **argv) {
+	explorer_config config = { 4, 10, 60, 1000000, (uint64_t) 1024 * 1024 * 1024, NULL, NULL };
+	uint16_t target_pc = 0;
+	const char *program = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			show_explorer_help();
+			return 0;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			config.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+			config.ticks_per_frame = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+			config.max_depth = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--states") == 0 && i + 1 < argc) {
+			config.max_states = strtoull(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+			config.max_bytes = strtoull(argv[++i], NULL, 0) * 1024 * 1024;
+		} else if (strcmp(argv[i], "--goal-pc") == 0 && i + 1 < argc) {
+			target_pc = strtoul(argv[++i], NULL, 0);
+			config.goal = &goal_pc;
+			config.goal_data = &target_pc;
+		} else {
+			program = argv[i];
+		}
+	}
+
+	if (!program || config.threads == 0 || config.ticks_per_frame == 0) {
+		show_explorer_help();
+		return 0;
+	}
+
+	chip8 *root = create_chip8(false);
+	if (!root || !load_program(root, program))
+		return 1;
+
+	explorer ex;
+	bool complete = explorer_init(&ex, &config) && explorer_run(&ex, root);
+	if (complete) {
+		EXPLORER_LOG(
+			"Depth %u, %lu states, %lu duplicates, %lu screens, %lu softlocks.\n",
+			ex.depth, (unsigned long) ex.states.count, (unsigned long) ex.duplicates,
+			(unsigned long) ex.screens.count, (unsigned long) ex.softlocks
+		);
+
+		if (ex.goal) {
+			EXPLORER_LOG("Goal reached:\n");
+			print_route(ex.goal);
+		}
+
+		if (ex.first_softlock) {
+			EXPLORER_LOG("First softlock found:\n");
+			print_route(ex.first_softlock);
+		}
+	}
+
+	explorer_destroy(&ex);
+	delete_chip8(root);
+
+	return complete ? 0 : 1;
+}
+
+static bool state_set_init(state_set *set, uint64_t capacity) {
+	// Keep the load under one half so probing stays short.
+	uint64_t slots = 1024;
+	while (slots < capacity * 2)
+		slots <<= 1;
+
+	set->slots = calloc(slots, sizeof(uint64_t));
+	set->mask = slots - 1;
+	atomic_init(&set->count, 0);
+
+	return set->slots != NULL;
+}
+
+// Returns true if the hash wasn't in the set (and now is).
+static bool state_set_insert(state_set *set, uint64_t hash) {
+	if (hash == 0)
+		hash = 1;
+
+	uint64_t slot = hash & set->mask;
+	for (uint64_t probes = 0; probes <= set->mask; ++probes, slot = (slot + 1) & set->mask) {
+		uint64_t current = atomic_load_explicit(&set->slots[slot], memory_order_relaxed);
+		if (current == hash)
+			return false;
+
+		if (current == 0) {
+			if (atomic_compare_exchange_strong(&set->slots[slot], &current, hash)) {
+				atomic_fetch_add_explicit(&set->count, 1, memory_order_relaxed);
+				return true;
+			}
+
+			// Someone else took the slot first, it might have been for the same hash.
+			if (current == hash)
+				return false;
+		}
+	}
+
+	return false;
+}
+
+static bool append_node(explorer_node ***array, size_t *count, size_t *capacity, explorer_node *node) {
+	if (*count == *capacity) {
+		size_t c = (*capacity) ? *capacity * 2 : 256;
+		explorer_node **a = realloc(*array, sizeof(explorer_node *) * c);
+		if (!a)
+			return false;
+
+		*array = a;
+		*capacity = c;
+	}
+
+	(*array)[(*count)++] = node;
+	return true;
+}
+
+static packed_state *pack_state(explorer *ex, const chip8 *chip) {
+	uint32_t pages = __builtin_popcount(chip->dirty & 0xFFFF);
+	size_t size = sizeof(packed_state) + pages * PAGE_SIZE + ((chip->dirty & DIRTY_DISPLAY) ? DISPLAY_SIZE / 8 : 0);
+	packed_state *state = malloc(size);
+	if (!state)
+		return NULL;
+
+	state->opcode = chip->opcode;
+	state->regs = chip->regs;
+	memcpy(state->stack, chip->stack, sizeof(state->stack));
+	memcpy(state->keyboard, chip->keyboard, sizeof(state->keyboard));
+	state->status = chip->status;
+	state->rng = chip->rng;
+	state->dirty = chip->dirty;
+	state->memory_hash = chip->memory_hash;
+	state->display_hash = chip->display_hash;
+	state->size = size;
+
+	uint8_t *data = state->data;
+	for (uint32_t dirty = chip->dirty & 0xFFFF; dirty != 0; dirty &= dirty - 1, data += PAGE_SIZE)
+		memcpy(data, chip->memory + __builtin_ctz(dirty) * PAGE_SIZE, PAGE_SIZE);
+
+	if (chip->dirty & DIRTY_DISPLAY) {
+		memset(data, 0, DISPLAY_SIZE / 8);
+		for (uint16_t p = 0; p < DISPLAY_SIZE; ++p)
+			data[p / 8] |= (&chip->display[0][0])[p] << (p % 8);
+	}
+
+	atomic_fetch_add_explicit(&ex->bytes, size, memory_order_relaxed);
+	return state;
+}
+
+// chip becomes the packed state again, only copying what differs from the last state unpacked into it.
+static void unpack_state(explorer *ex, const packed_state *state, chip8 *chip) {
+	chip8_reset(chip, ex->root);
+
+	const uint8_t *data = state->data;
+	for (uint32_t dirty = state->dirty & 0xFFFF; dirty != 0; dirty &= dirty - 1, data += PAGE_SIZE)
+		memcpy(chip->memory + __builtin_ctz(dirty) * PAGE_SIZE, data, PAGE_SIZE);
+
+	if (state->dirty & DIRTY_DISPLAY)
+		for (uint16_t p = 0; p < DISPLAY_SIZE; ++p)
+			(&chip->display[0][0])[p] = (data[p / 8] >> (p % 8)) & 0x1;
+
+	chip->opcode = state->opcode;
+	chip->regs = state->regs;
+	memcpy(chip->stack, state->stack, sizeof(chip->stack));
+	memcpy(chip->keyboard, state->keyboard, sizeof(chip->keyboard));
+	chip->status = state->status;
+	chip->rng = state->rng;
+	chip->memory_hash = state->memory_hash;
+	chip->display_hash = state->display_hash;
+	// Still relative to the root, so what the next frame writes is added to it.
+	chip->dirty = state->dirty;
+}
+
+static void release_state(explorer *ex, packed_state *state) {
+	if (state) {
+		atomic_fetch_sub_explicit(&ex->bytes, state->size, memory_order_relaxed);
+		free(state);
+	}
+}
+
+static explorer_node *new_node(explorer_worker *worker, explorer_node *parent, packed_state *state, uint64_t hash, uint8_t input) {
+	explorer_node *node = malloc(sizeof(explorer_node));
+	if (!node)
+		return NULL;
+
+	node->parent = parent;
+	node->state = state;
+	node->hash = hash;
+	node->depth = parent ? parent->depth + 1 : 0;
+	node->input = input;
+
+	if (!append_node(&worker->nodes, &worker->node_count, &worker->node_capacity, node)) {
+		free(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+bool explorer_init(explorer *ex, const explorer_config *config) {
+	memset(ex, 0, sizeof(explorer));
+	ex->config = *config;
+	atomic_init(&ex->stop, false);
+	atomic_init(&ex->failed, false);
+	atomic_init(&ex->bytes, 0);
+	atomic_init(&ex->duplicates, 0);
+	atomic_init(&ex->softlocks, 0);
+	atomic_init(&ex->goal, NULL);
+	atomic_init(&ex->first_softlock, NULL);
+
+	ex->workers = calloc(config->threads, sizeof(explorer_worker));
+	if (!ex->workers || pthread_barrier_init(&ex->barrier, NULL, config->threads) != 0) {
+		free(ex->workers);
+		ex->workers = NULL;
+		return false;
+	}
+
+	if (pthread_mutex_init(&ex->start_lock, NULL) != 0) {
+		pthread_barrier_destroy(&ex->barrier);
+		free(ex->workers);
+		ex->workers = NULL;
+		return false;
+	}
+
+	if (!state_set_init(&ex->states, config->max_states) || !state_set_init(&ex->screens, config->max_states)) {
+		EXPLORER_LOG("Not enough memory for %lu states.\n", (unsigned long) config->max_states);
+		return false;
+	}
+
+	for (uint32_t u = 0; u < config->threads; ++u) {
+		if (!deque_init(&ex->workers[u].current, 1024))
+			return false;
+		ex->workers[u].seed = u * 7919 + 1;
+	}
+
+	return true;
+}
+
+// Runs a frame with the current keyboard. Returns true if the goal was reached during it.
+static bool run_frame(explorer *ex, chip8 *chip) {
+	for (uint32_t u = 0; u < ex->config.ticks_per_frame; ++u) {
+		// Nothing happens until a key arrives, and that only happens in the next frame.
+		if (chip->status.need_keystroke)
+			break;
+
+		tick(chip);
+
+		if (ex->config.goal && ex->config.goal(chip, ex->config.goal_data))
+			return true;
+	}
+
+	// Those don't make a state different, only hint the host.
+	chip->status.need_redraw = false;
+	chip->status.need_sound = false;
+
+	return false;
+}
+
+static void expand(explorer *ex, explorer_worker *worker, explorer_node *node) {
+	chip8 *child = worker->scratch;
+	bool stuck = true;
+
+	for (uint8_t input = 0; input < EXPLORER_INPUTS && !atomic_load_explicit(&ex->stop, memory_order_relaxed); ++input) {
+		unpack_state(ex, node->state, child);
+
+		// Only the key of this branch is held during the frame.
+		memset(child->keyboard, false, sizeof(child->keyboard));
+		if (input != NO_INPUT)
+			change_key(child, input, true);
+
+		bool reached = run_frame(ex, child);
+		uint64_t hash = chip8_state_hash(child);
+
+		if (hash != node->hash)
+			stuck = false;
+
+		if (!state_set_insert(&ex->states, hash) && !reached) {
+			atomic_fetch_add_explicit(&ex->duplicates, 1, memory_order_relaxed);
+			continue;
+		}
+
+		packed_state *state = pack_state(ex, child);
+		explorer_node *n = state ? new_node(worker, node, state, hash, input) : NULL;
+		if (!n || !append_node(&worker->next, &worker->next_count, &worker->next_capacity, n)) {
+			if (!n)
+				release_state(ex, state);
+			atomic_store(&ex->failed, true);
+			atomic_store(&ex->stop, true);
+			break;
+		}
+
+		state_set_insert(&ex->screens, child->display_hash);
+
+		explorer_node *expected = NULL;
+		if (reached && atomic_compare_exchange_strong(&ex->goal, &expected, n))
+			atomic_store(&ex->stop, true);
+
+		if (atomic_load_explicit(&ex->states.count, memory_order_relaxed) >= ex->config.max_states ||
+				atomic_load_explicit(&ex->bytes, memory_order_relaxed) >= ex->config.max_bytes)
+			atomic_store(&ex->stop, true);
+	}
+
+	// No input at all changes anything, the program will stay in this state forever.
+	if (stuck && !atomic_load(&ex->stop)) {
+		explorer_node *expected = NULL;
+		atomic_fetch_add_explicit(&ex->softlocks, 1, memory_order_relaxed);
+		atomic_compare_exchange_strong(&ex->first_softlock, &expected, node);
+	}
+
+	release_state(ex, node->state);
+	node->state = NULL;
+}
+
+static explorer_node *next_node(explorer *ex, uint32_t id) {
+	explorer_node *node = deque_pop(&ex->workers[id].current);
+	if (node)
+		return node;
+
+	// Out of work, try to steal some starting from a random worker. Nothing is pushed
+	// to the current level while it's expanded, so if everyone is empty the level is done.
+	uint32_t threads = ex->config.threads;
+	unsigned int *seed = &ex->workers[id].seed;
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	uint32_t start = *seed % threads;
+	for (uint32_t u = 0; u < threads; ++u) {
+		uint32_t victim = (start + u) % threads;
+		if (victim != id && (node = deque_steal(&ex->workers[victim].current)))
+			return node;
+	}
+
+	return NULL;
+}
+
+// Done by a single thread between levels.
+static void advance_level(explorer *ex) {
+	size_t total = 0;
+	for (uint32_t u = 0; u < ex->config.threads; ++u)
+		total += ex->workers[u].next_count;
+
+	if (total != 0)
+		++ex->depth;
+
+	if (total == 0 || ex->depth >= ex->config.max_depth || atomic_load(&ex->stop)) {
+		ex->finished = true;
+		return;
+	}
+
+	// Each worker starts the next level with the nodes it found, stealing balances it out.
+	for (uint32_t u = 0; u < ex->config.threads; ++u) {
+		explorer_worker *worker = &ex->workers[u];
+		for (size_t n = 0; n < worker->next_count; ++n) {
+			if (!deque_push(&worker->current, worker->next[n])) {
+				// A level with nodes missing would be taken as the whole search.
+				atomic_store(&ex->failed, true);
+				atomic_store(&ex->stop, true);
+				ex->finished = true;
+				return;
+			}
+		}
+		worker->next_count = 0;
+	}
+}
+
+static void *explorer_thread_main(void *arg) {
+	explorer_thread *thread = arg;
+	explorer *ex = thread->ex;
+	explorer_worker *worker = &ex->workers[thread->id];
+
+	// Wait until every thread exists, if one couldn't be created nobody goes near the barrier.
+	pthread_mutex_lock(&ex->start_lock);
+	pthread_mutex_unlock(&ex->start_lock);
+	if (ex->finished)
+		return NULL;
+
+	while (true) {
+		explorer_node *node;
+		while (!atomic_load_explicit(&ex->stop, memory_order_relaxed) && (node = next_node(ex, thread->id)))
+			expand(ex, worker, node);
+
+		pthread_barrier_wait(&ex->barrier);
+		if (thread->id == 0)
+			advance_level(ex);
+		pthread_barrier_wait(&ex->barrier);
+
+		if (ex->finished)
+			break;
+	}
+
+	return NULL;
+}
+
+bool explorer_run(explorer *ex, const chip8 *root) {
+	// Every state is packed against this copy, so it starts without dirty pages.
+	if (!(ex->root = chip8_clone(root)))
+		return false;
+	ex->root->dirty = 0;
+
+	for (uint32_t u = 0; u < ex->config.threads; ++u)
+		if (!(ex->workers[u].scratch = chip8_clone(ex->root)))
+			return false;
+
+	packed_state *state = pack_state(ex, ex->root);
+	explorer_node *first = state ? new_node(&ex->workers[0], NULL, state, chip8_state_hash(ex->root), NO_INPUT) : NULL;
+	if (!first) {
+		release_state(ex, state);
+		return false;
+	}
+
+	state_set_insert(&ex->states, first->hash);
+	state_set_insert(&ex->screens, ex->root->display_hash);
+	if (!deque_push(&ex->workers[0].current, first))
+		return false;
+
+	pthread_t *threads = malloc(sizeof(pthread_t) * ex->config.threads);
+	explorer_thread *args = malloc(sizeof(explorer_thread) * ex->config.threads);
+	if (!threads || !args) {
+		free(threads);
+		free(args);
+		return false;
+	}
+
+	pthread_mutex_lock(&ex->start_lock);
+	uint32_t started = 0;
+	for (; started < ex->config.threads; ++started) {
+		args[started].ex = ex;
+		args[started].id = started;
+		if (pthread_create(&threads[started], NULL, &explorer_thread_main, &args[started]) != 0) {
+			EXPLORER_LOG("Couldn't create thread %u.\n", started);
+			ex->finished = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ex->start_lock);
+
+	for (uint32_t u = 0; u < started; ++u)
+		pthread_join(threads[u], NULL);
+
+	free(threads);
+	free(args);
+
+	if (atomic_load(&ex->failed))
+		EXPLORER_LOG("Ran out of memory, the search is incomplete.\n");
+
+	return started == ex->config.threads && !atomic_load(&ex->failed);
+}
+
+void print_route(explorer_node *node) {
+	static char keys[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+	// The path is stored from the end, walk it once to put it in order.
+	explorer_node **path = malloc(sizeof(explorer_node *) * (node->depth + 1));
+	if (!path)
+		return;
+
+	uint32_t length = 0;
+	for (explorer_node *n = node; n->parent; n = n->parent)
+		path[length++] = n;
+
+	printf("%u frames:", length);
+	while (length != 0) {
+		uint8_t input = path[--length]->input;
+		printf(" %c", (input == NO_INPUT) ? '-' : keys[input]);
+	}
+	printf("\n");
+
+	free(path);
+}
+
+void explorer_destroy(explorer *ex) {
+	if (ex->workers) {
+		for (uint32_t u = 0; u < ex->config.threads; ++u) {
+			explorer_worker *worker = &ex->workers[u];
+			for (size_t n = 0; n < worker->node_count; ++n) {
+				release_state(ex, worker->nodes[n]->state);
+				free(worker->nodes[n]);
+			}
+			delete_chip8(worker->scratch);
+
+			free(worker->nodes);
+			free(worker->next);
+			if (worker->current.items)
+				deque_destroy(&worker->current);
+		}
+
+		free(ex->workers);
+		pthread_barrier_destroy(&ex->barrier);
+		pthread_mutex_destroy(&ex->start_lock);
+	}
+
+	delete_chip8(ex->root);
+
+	free(ex->states.slots);
+	free(ex->screens.slots);
+	memset(ex, 0, sizeof(explorer));
+}
+
+void show_explorer_help() {
+	puts(
+		"chip8_explorer program.ch8 [--threads N] [--ticks N] [--depth N] [--states N] [--memory MB] [--goal-pc ADDR]\n"
+		"Explores every state the program can reach, branching on each key (or no key) held every frame.\n"
+		"--threads number of threads expanding the states (4 by default).\n"
+		"--ticks ticks in a frame (10 by default).\n"
+		"--depth stops after this many frames (60 by default).\n"
+		"--states stops after this many different states (1000000 by default).\n"
+		"--memory stops when the states waiting to be expanded take more than MB megabytes (1024 by default).\n"
+		"--goal-pc stops as soon as the program counter reaches ADDR and shows the shortest input to get there.\n"
+		"Inputs are shown one per frame, '-' is a frame without any key held.\n"
+		"--help will show this message and exit the program."
+	);
+}
@@ -0,0 +1,96 @@
+#ifndef __CHIP8_EXPLORER_H__
+#define __CHIP8_EXPLORER_H__
+
+#include "chip8.h"
+#include "chip8_deque.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define EXPLORER_LOG(...) printf("[EXPLORER] " __VA_ARGS__)
+
+// Every frame branches on each single key being held, plus one branch with no key at all.
+#define NO_INPUT 0x10
+#define EXPLORER_INPUTS 0x11
+
+// A state kept as what it doesn't share with the root: the pages written to since, the display
+// (one bit per pixel) if it changed, and the fields that are small enough to always be kept.
+typedef struct {
+	uint16_t opcode;
+	chip8_regs regs;
+	uint16_t stack[0x10];
+	bool keyboard[0x10];
+	chip8_status status;
+	uint32_t rng;
+	uint32_t dirty;			// Pages (and display) that differ from the root, in data in that order.
+	uint64_t memory_hash;
+	uint64_t display_hash;
+	size_t size;			// Of the whole allocation.
+	uint8_t data[];
+} packed_state;
+
+typedef struct explorer_node {
+	struct explorer_node *parent;
+	packed_state *state;		// Freed as soon as the node is expanded, only the path is kept.
+	uint64_t hash;
+	uint32_t depth;			// Frames since the root.
+	uint8_t input;			// Key held during the frame that led here (NO_INPUT if none).
+} explorer_node;
+
+// Lock free set of hashes using open addressing. 0 marks an empty slot.
+typedef struct {
+	_Atomic uint64_t *slots;
+	uint64_t mask;
+	atomic_uint_fast64_t count;
+} state_set;
+
+typedef struct {
+	uint32_t threads;
+	uint32_t ticks_per_frame;
+	uint32_t max_depth;
+	uint64_t max_states;
+	uint64_t max_bytes;		// Stops when the states waiting to be expanded take more than this.
+	// Optional, checked after every tick. Exploration stops at the first state for which it returns true.
+	bool (*goal)(const chip8 *chip8, void *data);
+	void *goal_data;
+} explorer_config;
+
+typedef struct {
+	work_deque current;		// Nodes of the level being expanded, other workers steal from here.
+	explorer_node **next;		// New nodes found, they make up the next level.
+	size_t next_count;
+	size_t next_capacity;
+	explorer_node **nodes;		// Every node this worker allocated, kept for the paths.
+	size_t node_count;
+	size_t node_capacity;
+	chip8 *scratch;			// Every state this worker expands is unpacked here.
+	unsigned int seed;		// Picks the victims when stealing.
+} explorer_worker;
+
+// Breadth first exploration of every state reachable from a snapshot.
+// Each level is expanded by a pool of threads that steal nodes from each other.
+typedef struct {
+	explorer_config config;
+	explorer_worker *workers;
+	chip8 *root;			// States are packed against it, its dirty pages are cleared.
+	pthread_barrier_t barrier;
+	pthread_mutex_t start_lock;	// Held until every thread was created, see explorer_run.
+	state_set states;		// Full state hashes seen so far.
+	state_set screens;		// Display hashes seen so far.
+	atomic_bool stop;
+	atomic_bool failed;		// Out of memory, nodes were lost and the search is incomplete.
+	atomic_uint_fast64_t bytes;	// Taken by packed states.
+	atomic_uint_fast64_t duplicates;
+	atomic_uint_fast64_t softlocks;
+	_Atomic(explorer_node *) goal;
+	_Atomic(explorer_node *) first_softlock;
+	uint32_t depth;
+	bool finished;
+} explorer;
+
+bool explorer_init(explorer *ex, const explorer_config *config);
+bool explorer_run(explorer *ex, const chip8 *root);
+void print_route(explorer_node *node);
+void explorer_destroy(explorer *ex);
+void show_explorer_help();
+
+#endif
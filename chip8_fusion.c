@@ -0,0 +1,198 @@
+#include "chip8_fusion.h"
+#include <stdlib.h>
+#include <string.h>
+
+decode_cache *create_decode_cache() {
+	decode_cache *cache = malloc(sizeof(decode_cache));
+	if (cache)
+		flush_decode_cache(cache);
+
+	return cache;
+}
+
+void delete_decode_cache(decode_cache *cache) {
+	free(cache);
+}
+
+void flush_decode_cache(decode_cache *cache) {
+	memset(cache->entries, 0, sizeof(cache->entries));
+	cache->fused = 0;
+}
+
+void invalidate_decode_cache(decode_cache *cache, uint16_t address, uint16_t length) {
+	// Entries starting up to a whole fused sequence before the address may cover it.
+	int32_t start = address - (FUSED_MAX_LENGTH * 2 - 1);
+	int32_t end = address + length;
+	if (start < 0)
+		start = 0;
+	if (end > 0x1000)
+		end = 0x1000;
+
+	for (int32_t a = start; a < end; ++a)
+		cache->entries[a].handler = NULL;
+}
+
+static uint8_t run_single(chip8 *chip8, const decoded_entry *entry) {
+	chip8->opcode = entry->opcodes[0];
+	chip8->regs.pc += 2;
+	if (entry->instruction)
+		(*entry->instruction)(chip8);
+
+	return 1;
+}
+
+// Annn; Dxyn: point I to a sprite and draw it.
+static uint8_t fused_ld_i_drw(chip8 *chip8, const decoded_entry *entry) {
+	chip8->regs.i = entry->opcodes[0] & 0x0FFF;
+	chip8->opcode = entry->opcodes[1];
+	chip8->regs.pc += 4;
+	drw_vx_vy_nibble(chip8);
+
+	return 2;
+}
+
+// 6xkk; 6ykk: setting up two registers.
+static uint8_t fused_ld_ld(chip8 *chip8, const decoded_entry *entry) {
+	chip8->regs.v[HB_LN(entry->opcodes[0])] = LB(entry->opcodes[0]);
+	chip8->regs.v[HB_LN(entry->opcodes[1])] = LB(entry->opcodes[1]);
+	chip8->opcode = entry->opcodes[1];
+	chip8->regs.pc += 4;
+
+	return 2;
+}
+
+// Annn; Fx65: loading registers from a table.
+static uint8_t fused_ld_i_ld_vx_at_i(chip8 *chip8, const decoded_entry *entry) {
+	chip8->regs.i = entry->opcodes[0] & 0x0FFF;
+	chip8->opcode = entry->opcodes[1];
+	chip8->regs.pc += 4;
+	ld_vx_at_i(chip8);
+
+	return 2;
+}
+
+// Fx07; 3xkk; 1nnn: polling the delay timer until it reaches kk.
+static uint8_t fused_timer_poll(chip8 *chip8, const decoded_entry *entry) {
+	uint8_t x = HB_LN(entry->opcodes[0]);
+	chip8->regs.v[x] = chip8->regs.delay_timer;
+	chip8->regs.pc += 4;
+
+	// The skip jumps over the 1nnn, which is then never executed.
+	if (chip8->regs.v[x] == LB(entry->opcodes[1])) {
+		chip8->opcode = entry->opcodes[1];
+		chip8->regs.pc += 2;
+		return 2;
+	}
+
+	chip8->opcode = entry->opcodes[2];
+	chip8->regs.pc = entry->opcodes[2] & 0x0FFF;
+	return 3;
+}
+
+// 7xkk; 3xkk; 1nnn: a counted loop.
+static uint8_t fused_counted_loop(chip8 *chip8, const decoded_entry *entry) {
+	uint8_t x = HB_LN(entry->opcodes[0]);
+	chip8->regs.v[x] += LB(entry->opcodes[0]);
+	chip8->regs.pc += 4;
+
+	if (chip8->regs.v[x] == LB(entry->opcodes[1])) {
+		chip8->opcode = entry->opcodes[1];
+		chip8->regs.pc += 2;
+		return 2;
+	}
+
+	chip8->opcode = entry->opcodes[2];
+	chip8->regs.pc = entry->opcodes[2] & 0x0FFF;
+	return 3;
+}
+
+static uint16_t opcode_at(chip8 *chip8, uint16_t address) {
+	return chip8->memory[address] << 8 | chip8->memory[address + 1];
+}
+
+// Decodes the instruction at address, fusing it with the ones after it when they form a known sequence.
+static void decode_entry(chip8 *chip8, decoded_entry *entry, uint16_t address) {
+	uint16_t op[FUSED_MAX_LENGTH] = { opcode_at(chip8, address), 0, 0 };
+	uint8_t available = 1;
+
+	// Only instructions that are fully inside memory can be part of a sequence.
+	for (; available < FUSED_MAX_LENGTH && address + available * 2 + 1 < sizeof(chip8->memory); ++available)
+		op[available] = opcode_at(chip8, address + available * 2);
+
+	memcpy(entry->opcodes, op, sizeof(op));
+	entry->handler = &run_single;
+	entry->length = 1;
+
+	// decode_instruction reads the opcode from the chip8, so it's swapped in for a moment.
+	uint16_t opcode = chip8->opcode;
+	chip8->opcode = op[0];
+	entry->instruction = decode_instruction(chip8);
+	chip8->opcode = opcode;
+
+	if (available < 2)
+		return;
+
+	uint8_t hn0 = HB_HN(op[0]), hn1 = HB_HN(op[1]);
+	bool same_x = HB_LN(op[0]) == HB_LN(op[1]);
+
+	if (available == 3 && HB_HN(op[2]) == 0x1 && hn1 == 0x3 && same_x) {
+		if (hn0 == 0xF && LB(op[0]) == 0x07) {
+			entry->handler = &fused_timer_poll;
+			entry->length = 3;
+			return;
+		} else if (hn0 == 0x7) {
+			entry->handler = &fused_counted_loop;
+			entry->length = 3;
+			return;
+		}
+	}
+
+	if (hn0 == 0xA && hn1 == 0xD) {
+		entry->handler = &fused_ld_i_drw;
+		entry->length = 2;
+	} else if (hn0 == 0x6 && hn1 == 0x6) {
+		entry->handler = &fused_ld_ld;
+		entry->length = 2;
+	} else if (hn0 == 0xA && hn1 == 0xF && LB(op[1]) == 0x65) {
+		entry->handler = &fused_ld_i_ld_vx_at_i;
+		entry->length = 2;
+	}
+}
+
+uint32_t run_fused(chip8 *chip8, uint32_t count) {
+	decode_cache *cache = chip8->cache;
+	uint32_t ticks = 0;
+
+	while (ticks < count && !chip8->status.fault && !chip8->status.need_keystroke) {
+		uint16_t pc = chip8->regs.pc;
+		if (pc >= sizeof(chip8->memory) - 1) {
+			// Same as fetch_instruction, the faulting fetch still takes a tick.
+			chip8->opcode = 0x0000;
+			chip8->status.fault = FAULT_PC;
+			update_timers(chip8);
+			++ticks;
+			break;
+		}
+
+		decoded_entry *entry = &cache->entries[pc];
+		if (!entry->handler)
+			decode_entry(chip8, entry, pc);
+
+		// The debug log wants every instruction, and a sequence can't go over what's left of the count.
+		uint8_t executed;
+		if (entry->length > 1 && entry->length <= count - ticks && !chip8->status.debug) {
+			executed = entry->handler(chip8, entry);
+			++cache->fused;
+		} else {
+			executed = run_single(chip8, entry);
+		}
+
+		// None of the fused instructions read the timers after the first one, so updating them
+		// at the end is the same as doing it after each instruction.
+		for (uint8_t u = 0; u < executed; ++u)
+			update_timers(chip8);
+		ticks += executed;
+	}
+
+	return ticks;
+}
@@ -0,0 +1,43 @@
+#ifndef __CHIP8_FUSION_H__
+#define __CHIP8_FUSION_H__
+
+#include "chip8.h"
+
+// Decode cache with superinstructions. Instructions are decoded once per address and common
+// sequences are fused into a single handler, so they skip fetch_instruction, decode_instruction
+// and the indirect call for every instruction but the first.
+//
+// Entries are kept by address, so a skip or jump landing in the middle of a fused sequence simply
+// finds the entry for that address. Writes to memory through write_memory invalidate every entry
+// that covers the address written to.
+
+// The longest sequence that is fused, in instructions.
+#define FUSED_MAX_LENGTH 3
+
+struct decoded_entry;
+// Runs the instructions of an entry and returns how many of them were executed.
+typedef uint8_t(*fused_ptr)(chip8 *, const struct decoded_entry *);
+
+typedef struct decoded_entry {
+	fused_ptr handler;			// NULL when the address wasn't decoded yet.
+	infn_ptr instruction;			// The instruction, when the entry isn't fused.
+	uint16_t opcodes[FUSED_MAX_LENGTH];
+	uint8_t length;
+} decoded_entry;
+
+typedef struct decode_cache {
+	decoded_entry entries[0x1000];
+	uint64_t fused;				// Fused entries executed, only for statistics.
+} decode_cache;
+
+decode_cache *create_decode_cache();
+void delete_decode_cache(decode_cache *cache);
+void flush_decode_cache(decode_cache *cache);
+void invalidate_decode_cache(decode_cache *cache, uint16_t address, uint16_t length);
+
+// Runs up to count ticks through the decode cache (chip8->cache must be set). Stops early on a fault
+// or when the program waits for a keystroke. The timers are updated once per instruction, like tick.
+// Returns how many ticks were run.
+uint32_t run_fused(chip8 *chip8, uint32_t count);
+
+#endif
@@ -0,0 +1,155 @@
+/* Persistent fuzzing harness: every input is a program that runs for a fixed amount of ticks.
+ * Build it with -DCHIP8_FUZZ_LIBFUZZER -fsanitize=fuzzer to use libFuzzer's driver,
+ * or without it to run files (or random programs) through the same entry point.
+ * With -DCHIP8_FUZZ_DIFFERENTIAL every program also runs without the decode cache,
+ * and any difference between both runs aborts. */
+#include "chip8.h"
+#include "chip8_fusion.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Ticks each program gets before it's considered done.
+#ifndef CHIP8_FUZZ_BUDGET
+#define CHIP8_FUZZ_BUDGET 1000
+#endif
+
+#define FUZZ_LOG(...) printf("[FUZZ] " __VA_ARGS__)
+
+static chip8 *template = NULL;	// The state every program starts from.
+static chip8 *instance = NULL;	// Reused between runs, only what a run dirtied is restored.
+static unsigned long faults[FAULT_PC + 1];
+
+#ifdef CHIP8_FUZZ_DIFFERENTIAL
+static chip8 *reference = NULL;	// Runs tick by tick, without the decode cache.
+
+static void run_reference(const uint8_t *data, size_t size) {
+	if (!reference && !(reference = chip8_clone(template)))
+		abort();
+	chip8_restore(reference, template);
+	load_program_data(reference, data, size);
+
+	uint8_t waits = 0;
+	for (uint32_t u = 0; u < CHIP8_FUZZ_BUDGET && !reference->status.fault; ++u) {
+		tick(reference);
+		if (reference->status.need_keystroke)
+			change_key(reference, waits++ & 0xF, true);
+	}
+
+	if (chip8_state_hash(reference) != chip8_state_hash(instance) || reference->status.fault != instance->status.fault) {
+		FUZZ_LOG("The decode cache and tick disagree (PC 0x%X and 0x%X).\n", instance->regs.pc, reference->regs.pc);
+		abort();
+	}
+}
+#endif
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if (!template) {
+		template = create_chip8(false);
+		if (!template)
+			abort();
+
+		// Same random numbers every run, so a finding can be reproduced.
+		template->rng = 0x1;
+		instance = chip8_clone(template);
+		if (!instance || !(instance->cache = create_decode_cache()))
+			abort();
+		chip8_restore(instance, template);
+	}
+
+	if (size > sizeof(instance->memory) - 0x200)
+		size = sizeof(instance->memory) - 0x200;
+	load_program_data(instance, data, size);
+
+	uint8_t waits = 0;
+	for (uint32_t ticks = 0; ticks < CHIP8_FUZZ_BUDGET && !instance->status.fault;) {
+		ticks += run_fused(instance, CHIP8_FUZZ_BUDGET - ticks);
+
+		// Nobody is there to press a key, give it a different one each time to keep going.
+		if (instance->status.need_keystroke)
+			change_key(instance, waits++ & 0xF, true);
+	}
+
+	++faults[instance->status.fault];
+
+#ifdef CHIP8_FUZZ_DIFFERENTIAL
+	run_reference(data, size);
+#endif
+
+#ifdef CHIP8_FUZZ_TRAP_ON_FAULT
+	// Turns faults into crashes, so the fuzzer keeps the programs that cause them.
+	if (instance->status.fault)
+		abort();
+#endif
+
+	chip8_reset_dirty(instance, template);
+	return 0;
+}
+
+#ifndef CHIP8_FUZZ_LIBFUZZER
+static bool run_file(const char *filename) {
+	static uint8_t data[0x1000];
+
+	FILE *file = fopen(filename, "rb");
+	if (!file) {
+		FUZZ_LOG("Couldn't open \"%s\".\n", filename);
+		return false;
+	}
+
+	size_t size = fread(data, sizeof(uint8_t), sizeof(data), file);
+	fclose(file);
+
+	LLVMFuzzerTestOneInput(data, size);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2 || strcmp(argv[1], "--help") == 0) {
+		puts(
+			"chip8_fuzz program.ch8 [program.ch8 ...]\n"
+			"chip8_fuzz --random <count> [size]\n"
+			"Runs each program (or count random programs of size bytes) for a fixed budget of ticks and counts the faults.\n"
+			"--help will show this message and exit the program."
+		);
+		return 0;
+	}
+
+	clock_t start = clock();
+	unsigned long runs = 0;
+
+	if (strcmp(argv[1], "--random") == 0 && argc >= 3) {
+		unsigned long count = strtoul(argv[2], NULL, 0);
+		size_t size = (argc >= 4) ? strtoul(argv[3], NULL, 0) : 0x100;
+		uint8_t *data = malloc(size);
+		if (!data)
+			return 1;
+
+		srand(time(NULL));
+		for (; runs < count; ++runs) {
+			for (size_t u = 0; u < size; ++u)
+				data[u] = rand();
+			LLVMFuzzerTestOneInput(data, size);
+		}
+
+		free(data);
+	} else {
+		for (int i = 1; i < argc; ++i)
+			if (run_file(argv[i]))
+				++runs;
+	}
+
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+	FUZZ_LOG("%lu runs in %.2fs (%.0f runs/s).\n", runs, seconds, (seconds > 0) ? runs / seconds : 0.0);
+	FUZZ_LOG(
+		"Faults: stack overflow %lu, stack underflow %lu, memory %lu, pc %lu.\n",
+		faults[FAULT_STACK_OVERFLOW], faults[FAULT_STACK_UNDERFLOW], faults[FAULT_MEMORY], faults[FAULT_PC]
+	);
+
+	delete_decode_cache(instance->cache);
+	delete_chip8(instance);
+	delete_chip8(template);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,320 @@
+#include "chip8_grid.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define PIXEL_ON 0xFFFFFFFF
+#define PIXEL_OFF 0xFF000000
+
+int main(int argc, char **argv) {
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			show_grid_help();
+			return 0;
+		}
+	}
+
+	if (argc >= 6) {
+		grid_struct gs;
+
+		uint16_t columns = atoi(argv[1]);
+		uint16_t rows = atoi(argv[2]);
+		uint8_t scale = atoi(argv[3]);
+		uint32_t cycle_ms = atoi(argv[4]);
+
+		if (initialize_grid(&gs, columns, rows, scale, cycle_ms, argv + 5, argc - 5)) {
+			while (gs.running) {
+				SDL_Delay(gs.cycle_ms);
+				update_grid(&gs);
+				render_grid(&gs);
+			}
+		}
+
+		destroy_grid(&gs);
+	} else {
+		show_grid_help();
+	}
+
+	return 0;
+}
+
+bool initialize_grid(grid_struct *gs, uint16_t columns, uint16_t rows, uint8_t scale, uint32_t cycle_ms, char **programs, int program_count) {
+	memset(gs, 0, sizeof(grid_struct));
+
+	if (columns == 0 || rows == 0 || scale == 0) {
+		GRID_LOG("Columns, rows and scale must be greater than 0.\n");
+		return false;
+	}
+
+	if (columns * DISPLAY_WIDTH > GRID_MAX_ATLAS_SIZE || rows * DISPLAY_HEIGHT > GRID_MAX_ATLAS_SIZE) {
+		GRID_LOG("A %ux%u grid doesn't fit in a single atlas.\n", columns, rows);
+		return false;
+	}
+
+	gs->columns = columns;
+	gs->rows = rows;
+	gs->scale = scale;
+	gs->cycle_ms = cycle_ms;
+	default_keymap(&gs->keymap);
+
+	SDL_Init(SDL_INIT_VIDEO);
+
+	gs->window = SDL_CreateWindow(
+		"CHIP 8 Interpreter - Grid",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		columns * DISPLAY_WIDTH * scale,
+		rows * DISPLAY_HEIGHT * scale,
+		SDL_WINDOW_OPENGL
+	);
+
+	if (!gs->window) {
+		fprintf(stderr, "An error occurred when creating the Window. %s\n", SDL_GetError());
+		return false;
+	}
+
+	gs->renderer = SDL_CreateRenderer(gs->window, -1, 0);
+	if (!gs->renderer) {
+		fprintf(stderr, "An error occurred when creating the renderer. %s\n", SDL_GetError());
+		return false;
+	}
+
+	// A single texture with every display side by side. Each tile is 64x32 texels and
+	// the renderer does the scaling when the whole atlas is copied to the window.
+	gs->atlas = SDL_CreateTexture(
+		gs->renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		columns * DISPLAY_WIDTH,
+		rows * DISPLAY_HEIGHT
+	);
+
+	if (!gs->atlas) {
+		fprintf(stderr, "An error occurred when creating the atlas. %s\n", SDL_GetError());
+		return false;
+	}
+
+	const uint32_t instances = columns * rows;
+	gs->atlas_pixels = malloc(sizeof(uint32_t) * instances * DISPLAY_WIDTH * DISPLAY_HEIGHT);
+	gs->chips = calloc(instances, sizeof(chip8 *));
+	gs->dirty_tiles = malloc(sizeof(uint16_t) * instances);
+	gs->tile_queued = calloc(instances, sizeof(bool));
+	gs->dirty_count = 0;
+	if (!gs->atlas_pixels || !gs->chips || !gs->dirty_tiles || !gs->tile_queued) {
+		GRID_LOG("Not enough memory for %u instances.\n", instances);
+		return false;
+	}
+
+	// Programs are handed out to the tiles in order, starting again from the first
+	// when there are more tiles than programs.
+	for (uint32_t u = 0; u < instances; ++u) {
+		gs->chips[u] = create_chip8(false);
+		if (!gs->chips[u] || !load_program(gs->chips[u], programs[u % program_count]))
+			return false;
+
+		blit_tile(gs, u);
+	}
+
+	gs->running = true;
+	return true;
+}
+
+void update_grid(grid_struct *gs) {
+	// Process SDL events.
+	while (SDL_PollEvent(&gs->event)) {
+		if (gs->event.type == SDL_QUIT) {
+			gs->running = false;
+		} else if (gs->event.type == SDL_KEYDOWN) {
+			process_grid_key_event(gs, &gs->event.key.keysym, true);
+		} else if (gs->event.type == SDL_KEYUP) {
+			process_grid_key_event(gs, &gs->event.key.keysym, false);
+		} else if (gs->event.type == SDL_MOUSEBUTTONDOWN) {
+			process_grid_mouse_event(gs, &gs->event.button);
+		}
+	}
+
+	if (gs->paused)
+		return;
+
+	const uint32_t instances = gs->columns * gs->rows;
+	for (uint32_t u = 0; u < instances; ++u) {
+		chip8 *chip = gs->chips[u];
+
+		// An instance waiting for a keystroke doesn't hold the others back,
+		// it simply stops ticking until change_key gives it the key.
+		if (chip->status.need_keystroke)
+			continue;
+
+		tick(chip);
+		chip->status.need_sound = false;
+
+		// Tiles whose display didn't change keep what's already in the atlas.
+		if (chip->status.need_redraw)
+			blit_tile(gs, u);
+	}
+}
+
+void render_grid(grid_struct *gs) {
+	if (!gs->atlas_dirty)
+		return;
+
+	// Only the tiles that changed are uploaded, then all of them are drawn with a single copy.
+	const uint32_t pitch = gs->columns * DISPLAY_WIDTH;
+	for (uint32_t d = 0; d < gs->dirty_count; ++d) {
+		uint16_t index = gs->dirty_tiles[d];
+		SDL_Rect tile = {
+			(index % gs->columns) * DISPLAY_WIDTH,
+			(index / gs->columns) * DISPLAY_HEIGHT,
+			DISPLAY_WIDTH,
+			DISPLAY_HEIGHT
+		};
+		SDL_UpdateTexture(gs->atlas, &tile, gs->atlas_pixels + tile.y * pitch + tile.x, pitch * sizeof(uint32_t));
+		gs->tile_queued[index] = false;
+	}
+	gs->dirty_count = 0;
+
+	SDL_SetRenderDrawColor(gs->renderer, 0x0, 0x0, 0x0, 0xFF);
+	SDL_RenderClear(gs->renderer);
+
+	if (gs->zoomed) {
+		SDL_Rect tile = {
+			(gs->selected % gs->columns) * DISPLAY_WIDTH,
+			(gs->selected / gs->columns) * DISPLAY_HEIGHT,
+			DISPLAY_WIDTH,
+			DISPLAY_HEIGHT
+		};
+		SDL_RenderCopy(gs->renderer, gs->atlas, &tile, NULL);
+	} else {
+		SDL_RenderCopy(gs->renderer, gs->atlas, NULL, NULL);
+
+		// Outline the instance receiving the input.
+		SDL_Rect outline = {
+			(gs->selected % gs->columns) * DISPLAY_WIDTH * gs->scale,
+			(gs->selected / gs->columns) * DISPLAY_HEIGHT * gs->scale,
+			DISPLAY_WIDTH * gs->scale,
+			DISPLAY_HEIGHT * gs->scale
+		};
+		SDL_SetRenderDrawColor(gs->renderer, 0xFF, 0x0, 0x0, 0xFF);
+		SDL_RenderDrawRect(gs->renderer, &outline);
+	}
+
+	SDL_RenderPresent(gs->renderer);
+	gs->atlas_dirty = false;
+}
+
+// Copies an instance's display into it's tile of the atlas.
+void blit_tile(grid_struct *gs, uint16_t index) {
+	const uint32_t pitch = gs->columns * DISPLAY_WIDTH;
+	uint32_t *tile = gs->atlas_pixels + (index / gs->columns) * DISPLAY_HEIGHT * pitch + (index % gs->columns) * DISPLAY_WIDTH;
+	chip8 *chip = gs->chips[index];
+
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; ++y)
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; ++x)
+			tile[y * pitch + x] = chip->display[y][x] ? PIXEL_ON : PIXEL_OFF;
+
+	// Disable chip8 need_redraw status. (Should be done if using chip8.h)
+	chip->status.need_redraw = false;
+	if (!gs->tile_queued[index]) {
+		gs->tile_queued[index] = true;
+		gs->dirty_tiles[gs->dirty_count++] = index;
+	}
+	gs->atlas_dirty = true;
+}
+
+void select_tile(grid_struct *gs, uint16_t index) {
+	if (index == gs->selected)
+		return;
+
+	// Keys held on the previous instance would otherwise stay pressed forever.
+	for (uint8_t key = 0; key < 0x10; ++key)
+		if (check_key(gs->chips[gs->selected], key))
+			change_key(gs->chips[gs->selected], key, false);
+
+	gs->selected = index;
+	gs->atlas_dirty = true;
+	GRID_LOG("Selected instance %u.\n", index);
+}
+
+void process_grid_key_event(grid_struct *gs, SDL_Keysym *keysim, bool value) {
+	if (value) {
+		const uint16_t instances = gs->columns * gs->rows;
+
+		if (keysim->sym == SDLK_TAB) {
+			select_tile(gs, (gs->selected + 1) % instances);
+			return;
+		} else if (keysim->sym == SDLK_RETURN) {
+			gs->zoomed = !gs->zoomed;
+			gs->atlas_dirty = true;
+			return;
+		} else if (keysim->sym == SDLK_ESCAPE) {
+			gs->zoomed = false;
+			gs->atlas_dirty = true;
+			return;
+		} else if (keysim->sym == SDLK_p) {
+			gs->paused = !gs->paused;
+			GRID_LOG("Pause %s.\n", (gs->paused) ? "enabled" : "disabled");
+			return;
+		}
+	}
+
+	if (!gs->paused) {
+		uint8_t key = map_key(&gs->keymap, keysim);
+		if (key != NO_KEY)
+			change_key(gs->chips[gs->selected], key, value);
+	}
+}
+
+void process_grid_mouse_event(grid_struct *gs, SDL_MouseButtonEvent *button) {
+	if (button->button != SDL_BUTTON_LEFT || gs->zoomed)
+		return;
+
+	uint16_t column = button->x / (DISPLAY_WIDTH * gs->scale);
+	uint16_t row = button->y / (DISPLAY_HEIGHT * gs->scale);
+	if (column < gs->columns && row < gs->rows) {
+		select_tile(gs, row * gs->columns + column);
+
+		// Double clicking a tile zooms into it.
+		if (button->clicks == 2) {
+			gs->zoomed = true;
+			gs->atlas_dirty = true;
+		}
+	}
+}
+
+void destroy_grid(grid_struct *gs) {
+	if (gs->chips) {
+		for (uint32_t u = 0; u < gs->columns * gs->rows; ++u)
+			delete_chip8(gs->chips[u]);
+		free(gs->chips);
+	}
+
+	free(gs->atlas_pixels);
+	free(gs->dirty_tiles);
+	free(gs->tile_queued);
+
+	if (gs->atlas)
+		SDL_DestroyTexture(gs->atlas);
+	if (gs->renderer)
+		SDL_DestroyRenderer(gs->renderer);
+	if (gs->window)
+		SDL_DestroyWindow(gs->window);
+	SDL_Quit();
+}
+
+void show_grid_help() {
+	puts(
+		"chip8_grid <columns> <rows> <scale> <cycle_ms> program.ch8 [program.ch8 ...]\n"
+		"Runs columns x rows instances in a single window, the programs are handed out to the tiles in order.\n"
+		"scale = int8_t (will scale the dimensions of each 64x32 tile).\n"
+		"cycle_ms = int32_t (the amount of time the interpreter will sleep between each cycle).\n"
+		"--help will show this message and exit the program.\n"
+		"Grid keys:\n"
+		"Left click selects the instance that receives the chip8 keys, double click zooms into it\n"
+		"Tab selects the next instance\n"
+		"Enter will zoom in/out of the selected instance\n"
+		"Escape will zoom out\n"
+		"P will pause every instance\n"
+		"The chip8 keys are the same as in chip8_interpreter (see chip8_interpreter --help)."
+	);
+}
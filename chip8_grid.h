@@ -0,0 +1,47 @@
+#ifndef __CHIP8_GRID_H__
+#define __CHIP8_GRID_H__
+
+#include "chip8.h"
+#include "chip8_input.h"
+#include "SDL2/SDL.h"
+
+#define GRID_LOG(...) printf("[GRID] " __VA_ARGS__)
+
+// The atlas can't be bigger than what most renderers accept for a single texture.
+#define GRID_MAX_ATLAS_SIZE 8192
+
+// Hosts columns x rows chip8 instances in a single window.
+// Every instance's display lives in one atlas texture that is drawn with a single copy.
+typedef struct {
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *atlas;
+	SDL_Event event;
+	keymap keymap;
+	uint32_t *atlas_pixels;		// CPU side copy of the atlas (streaming textures don't keep their content).
+	bool atlas_dirty;		// A tile, the selection or the zoom changed since the last present.
+	uint16_t *dirty_tiles;		// Tiles changed since the last upload, each only uploaded once.
+	uint32_t dirty_count;
+	bool *tile_queued;		// Whether each tile is already in dirty_tiles.
+	chip8 **chips;
+	uint16_t columns;
+	uint16_t rows;
+	uint16_t selected;		// Instance that receives keyboard input.
+	bool zoomed;			// Only the selected instance is shown, filling the window.
+	bool running;
+	bool paused;
+	uint32_t cycle_ms;
+	uint8_t scale;
+} grid_struct;
+
+bool initialize_grid(grid_struct *gs, uint16_t columns, uint16_t rows, uint8_t scale, uint32_t cycle_ms, char **programs, int program_count);
+void update_grid(grid_struct *gs);
+void render_grid(grid_struct *gs);
+void blit_tile(grid_struct *gs, uint16_t index);
+void select_tile(grid_struct *gs, uint16_t index);
+void process_grid_key_event(grid_struct *gs, SDL_Keysym *keysim, bool value);
+void process_grid_mouse_event(grid_struct *gs, SDL_MouseButtonEvent *button);
+void destroy_grid(grid_struct *gs);
+void show_grid_help();
+
+#endif
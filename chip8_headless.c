@@ -0,0 +1,340 @@
+/* Runs a program without a window, for scripts and machines without a display.
+ * Only the core is linked (no SDL), so starting up is just loading the program. */
+#include "chip8.h"
+#include "chip8_fusion.h"
+#include "chip8_timing.h"
+#include "chip8_profile.h"
+#include "chip8_scale.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADLESS_LOG(...) printf("[HEADLESS] " __VA_ARGS__)
+
+// Ticks given to run_fused at a time, so a key wait is noticed between calls.
+#define HEADLESS_CHUNK 0x10000
+
+typedef struct {
+	const char *program;
+	uint64_t cycles;	// Ticks to run, when frames is 0.
+	uint64_t frames;	// VIP frames to run.
+	bool registers;
+	bool hash;
+	const char *png;
+	const char *raw;	// Scaled RGBA frames are appended here.
+	uint8_t scale;
+	uint8_t filter;
+	bool seeded;
+	uint32_t seed;
+	const char *profile;	// Folded stacks are written here.
+	uint32_t profile_period;	// Instructions between samples, 0 counts every one.
+	chip8_host host;		// Only attached when there are breakpoints.
+	bool breakpoints;
+} headless_config;
+
+static const char *fault_names[] = { "none", "stack overflow", "stack underflow", "memory", "pc" };
+
+// CRC-32 as used by PNG, a nibble at a time so there's no table to build on startup.
+static const uint32_t crc_nibbles[0x10] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+	for (size_t u = 0; u < length; ++u) {
+		crc = (crc >> 4) ^ crc_nibbles[(crc ^ data[u]) & 0xF];
+		crc = (crc >> 4) ^ crc_nibbles[(crc ^ (data[u] >> 4)) & 0xF];
+	}
+
+	return crc;
+}
+
+static void write_u32(uint8_t *out, uint32_t value) {
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+static bool write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t length) {
+	uint8_t header[8], footer[4];
+	write_u32(header, length);
+	memcpy(header + 4, type, 4);
+
+	uint32_t crc = crc32_update(0xFFFFFFFF, header + 4, 4);
+	crc = crc32_update(crc, data, length);
+	write_u32(footer, crc ^ 0xFFFFFFFF);
+
+	return fwrite(header, 1, sizeof(header), file) == sizeof(header)
+		&& fwrite(data, 1, length, file) == length
+		&& fwrite(footer, 1, sizeof(footer), file) == sizeof(footer);
+}
+
+// Colors in the byte order R, G, B, A, whatever the machine's endianness.
+static uint32_t rgba_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	uint8_t bytes[4] = { r, g, b, a };
+	uint32_t color;
+	memcpy(&color, bytes, sizeof(color));
+
+	return color;
+}
+
+// Writes scaled pixels (from scale_display) as an 8-bit RGBA PNG. The image data is zlib without
+// compression (stored blocks), which is still a valid PNG and needs nothing but a checksum.
+static bool write_png(const uint32_t *pixels, const char *filename, uint8_t scale) {
+	uint32_t width = DISPLAY_WIDTH * scale, height = DISPLAY_HEIGHT * scale;
+	size_t row_length = (size_t) width * sizeof(uint32_t);
+	size_t raw_length = (row_length + 1) * height;	// Each row starts with it's filter type.
+	size_t blocks = (raw_length + 0xFFFE) / 0xFFFF;
+	size_t zlib_length = 2 + blocks * 5 + raw_length + 4;
+
+	uint8_t *raw = malloc(raw_length);
+	uint8_t *zlib = malloc(zlib_length);
+	if (!raw || !zlib) {
+		free(raw);
+		free(zlib);
+		return false;
+	}
+
+	for (uint32_t y = 0; y < height; ++y) {
+		uint8_t *row = raw + (row_length + 1) * y;
+		row[0] = 0;
+		memcpy(row + 1, pixels + (size_t) width * y, row_length);
+	}
+
+	uint8_t *out = zlib;
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	uint32_t adler_a = 1, adler_b = 0;
+	for (size_t offset = 0; offset < raw_length;) {
+		uint16_t length = (raw_length - offset > 0xFFFF) ? 0xFFFF : raw_length - offset;
+		*out++ = (offset + length == raw_length);	// BFINAL on the last block, BTYPE 00.
+		*out++ = length & 0xFF;
+		*out++ = length >> 8;
+		*out++ = ~length & 0xFF;
+		*out++ = (~length >> 8) & 0xFF;
+		memcpy(out, raw + offset, length);
+		out += length;
+
+		for (uint16_t u = 0; u < length; ++u) {
+			adler_a = (adler_a + raw[offset + u]) % 65521;
+			adler_b = (adler_b + adler_a) % 65521;
+		}
+		offset += length;
+	}
+	write_u32(out, adler_b << 16 | adler_a);
+
+	uint8_t ihdr[13];
+	write_u32(ihdr, width);
+	write_u32(ihdr + 4, height);
+	ihdr[8] = 8;	// Bit depth.
+	ihdr[9] = 6;	// RGBA.
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	bool written = false;
+	FILE *file = fopen(filename, "wb");
+	if (file) {
+		written = fwrite(signature, 1, sizeof(signature), file) == sizeof(signature)
+			&& write_chunk(file, "IHDR", ihdr, sizeof(ihdr))
+			&& write_chunk(file, "IDAT", zlib, zlib_length)
+			&& write_chunk(file, "IEND", NULL, 0);
+		written = (fclose(file) == 0) && written;
+	}
+
+	free(raw);
+	free(zlib);
+	return written;
+}
+
+static void show_headless_help() {
+	puts(
+		"chip8_headless program.ch8 [--cycles <n> | --frames <n>] [--registers] [--hash] [--png <file>] [--scale <n>] [--seed <n>]\n"
+		"	[--filter <nearest|epx|scanlines>] [--raw <file>] [--profile <file> [--profile-period <n>]]\n"
+		"	[--break <address> ...]\n"
+		"Runs the program without a window and prints what was asked for when it's done.\n"
+		"--cycles runs n ticks (the default is 1000), --frames runs n 60 Hz frames of the COSMAC VIP timing model.\n"
+		"--registers prints the registers, --hash the display and state hashes, --png writes the display (scaled by --scale).\n"
+		"--raw appends the display as RGBA pixels (scaled and filtered like the PNG) after every frame, or once at the end with --cycles.\n"
+		"--seed fixes the random number generator, so runs can be compared.\n"
+		"--profile writes the program's call stacks in folded format and prints the time spent in each subroutine.\n"
+		"Every instruction is counted, unless --profile-period takes a sample every n instructions instead. With --frames there is a sample per frame.\n"
+		"--break stops before the instruction at address is executed, it can be given more than once (with --cycles, without --profile).\n"
+		"It stops early if the program faults or waits for a key, as there's no one to press it.\n"
+		"--help will show this message and exit the program."
+	);
+}
+
+int main(int argc, char **argv) {
+	headless_config config = { NULL, 1000, 0, false, false, NULL, NULL, 1, FILTER_NEAREST, false, 0, NULL, 0 };
+	init_host(&config.host);
+	config.breakpoints = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			show_headless_help();
+			return 0;
+		} else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+			config.cycles = strtoull(argv[++i], NULL, 0);
+			config.frames = 0;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			config.frames = strtoull(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--registers") == 0) {
+			config.registers = true;
+		} else if (strcmp(argv[i], "--hash") == 0) {
+			config.hash = true;
+		} else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc) {
+			config.png = argv[++i];
+		} else if (strcmp(argv[i], "--raw") == 0 && i + 1 < argc) {
+			config.raw = argv[++i];
+		} else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			if (!parse_scale_filter(argv[++i], &config.filter))
+				HEADLESS_LOG("Unknown filter \"%s\", using nearest.\n", argv[i]);
+		} else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+			config.scale = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			config.seed = strtoul(argv[++i], NULL, 0);
+			config.seeded = true;
+		} else if (strcmp(argv[i], "--break") == 0 && i + 1 < argc) {
+			set_breakpoint(&config.host, strtoul(argv[++i], NULL, 0), true);
+			config.breakpoints = true;
+		} else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			config.profile = argv[++i];
+		} else if (strcmp(argv[i], "--profile-period") == 0 && i + 1 < argc) {
+			config.profile_period = strtoul(argv[++i], NULL, 0);
+		} else {
+			config.program = argv[i];
+		}
+	}
+
+	if (!config.program || config.scale == 0) {
+		show_headless_help();
+		return 0;
+	}
+
+	chip8 *chip = create_chip8(false);
+	if (!chip || !load_program(chip, config.program))
+		return 1;
+
+	// xorshift can't start from 0.
+	if (config.seeded)
+		chip->rng = config.seed ? config.seed : 0x1;
+
+	profile prof;
+	if (config.profile && !profile_init(&prof))
+		return 1;
+
+	// Both image outputs share the scaled pixels.
+	uint32_t *pixels = NULL;
+	size_t pixels_length = (size_t) DISPLAY_WIDTH * config.scale * DISPLAY_HEIGHT * config.scale;
+	size_t pitch = (size_t) DISPLAY_WIDTH * config.scale * sizeof(uint32_t);
+	uint32_t on = rgba_color(0xFF, 0xFF, 0xFF, 0xFF), off = rgba_color(0x00, 0x00, 0x00, 0xFF);
+	if ((config.png || config.raw) && !(pixels = malloc(pixels_length * sizeof(uint32_t))))
+		return 1;
+
+	FILE *raw = NULL;
+	if (config.raw && !(raw = fopen(config.raw, "wb"))) {
+		HEADLESS_LOG("Couldn't open \"%s\".\n", config.raw);
+		return 1;
+	}
+
+	uint64_t ticks = 0;
+	chip8_exit reason = RUN_BUDGET;
+	if (config.frames) {
+		vip_timing timing;
+		vip_timing_init(&timing, true);
+		while (timing.frames < config.frames && !chip->status.fault && !chip->status.need_keystroke) {
+			// A sample per frame, the instructions inside it can't be seen from here.
+			uint32_t executed = vip_run_frame(chip, &timing);
+			if (config.profile)
+				profile_sample(&prof, chip, executed);
+			ticks += executed;
+
+			if (raw) {
+				scale_display(&chip->display[0][0], config.filter, config.scale, on, off, pixels, pitch);
+				fwrite(pixels, sizeof(uint32_t), pixels_length, raw);
+			}
+		}
+	} else if (config.profile && !config.profile_period) {
+		while (ticks < config.cycles && !chip->status.fault && !chip->status.need_keystroke) {
+			profile_instruction(&prof, chip);
+			tick(chip);
+			++ticks;
+		}
+	} else if (config.breakpoints) {
+		chip->host = &config.host;
+		while (ticks < config.cycles && reason == RUN_BUDGET) {
+			uint64_t left = config.cycles - ticks;
+			ticks += chip8_run(chip, (left > HEADLESS_CHUNK) ? HEADLESS_CHUNK : left, &reason);
+		}
+	} else {
+		chip->cache = create_decode_cache();
+		if (!chip->cache)
+			return 1;
+
+		uint64_t chunk = (config.profile && config.profile_period < HEADLESS_CHUNK) ? config.profile_period : HEADLESS_CHUNK;
+		while (ticks < config.cycles && !chip->status.fault && !chip->status.need_keystroke) {
+			uint64_t left = config.cycles - ticks;
+			uint32_t executed = run_fused(chip, (left > chunk) ? chunk : left);
+			if (config.profile)
+				profile_sample(&prof, chip, executed);
+			ticks += executed;
+		}
+	}
+
+	HEADLESS_LOG("Ran %llu ticks.", (unsigned long long) ticks);
+	if (chip->status.fault)
+		printf(" Stopped by a fault (%s) at PC 0x%X.", fault_names[chip->status.fault], chip->regs.pc);
+	else if (chip->status.need_keystroke)
+		printf(" Stopped waiting for a key at PC 0x%X.", chip->regs.pc);
+	else if (reason == RUN_BREAKPOINT)
+		printf(" Stopped at the breakpoint at 0x%X.", chip->regs.pc);
+	putchar('\n');
+
+	if (config.registers)
+		print_registers(chip);
+
+	if (config.hash) {
+		HEADLESS_LOG("Display hash: %016llx\n", (unsigned long long) chip->display_hash);
+		HEADLESS_LOG("State hash: %016llx\n", (unsigned long long) chip8_state_hash(chip));
+	}
+
+	if (pixels)
+		scale_display(&chip->display[0][0], config.filter, config.scale, on, off, pixels, pitch);
+
+	int result = 0;
+	if (raw) {
+		if (!config.frames)
+			fwrite(pixels, sizeof(uint32_t), pixels_length, raw);
+		if (ferror(raw) | fclose(raw)) {
+			HEADLESS_LOG("Couldn't write \"%s\".\n", config.raw);
+			result = 1;
+		}
+	}
+
+	if (config.profile) {
+		FILE *file = fopen(config.profile, "w");
+		if (file) {
+			profile_write_folded(&prof, file);
+			fclose(file);
+		} else {
+			HEADLESS_LOG("Couldn't write \"%s\".\n", config.profile);
+			result = 1;
+		}
+
+		profile_print_routines(&prof);
+		profile_destroy(&prof);
+	}
+
+	if (config.png && !write_png(pixels, config.png, config.scale)) {
+		HEADLESS_LOG("Couldn't write \"%s\".\n", config.png);
+		result = 1;
+	}
+
+	free(pixels);
+	delete_decode_cache(chip->cache);
+	delete_chip8(chip);
+
+	return result;
+}
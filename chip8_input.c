@@ -0,0 +1,154 @@
+#include "chip8_input.h"
+#include <string.h>
+
+/*
+			MAPS INTO 
+   CHIP 8 Keyboard	    |	QWERTY Keyboard
+   1	2	3	C   |	1	2	3	4
+   4	5	6	D   |	Q	W	E	R
+   7	8	9	E   |	A	S	D	F
+   A	0	B	F   | 	Z	X	C	V
+*/
+void default_keymap(keymap *km) {
+	memset(km->keys, NO_KEY, sizeof(km->keys));
+
+	// Scancodes are physical positions, so this layout holds even on non QWERTY keyboards.
+	km->keys[SDL_SCANCODE_1] = K_1;
+	km->keys[SDL_SCANCODE_2] = K_2;
+	km->keys[SDL_SCANCODE_3] = K_3;
+	km->keys[SDL_SCANCODE_4] = K_C;
+	km->keys[SDL_SCANCODE_Q] = K_4;
+	km->keys[SDL_SCANCODE_W] = K_5;
+	km->keys[SDL_SCANCODE_E] = K_6;
+	km->keys[SDL_SCANCODE_R] = K_D;
+	km->keys[SDL_SCANCODE_A] = K_7;
+	km->keys[SDL_SCANCODE_S] = K_8;
+	km->keys[SDL_SCANCODE_D] = K_9;
+	km->keys[SDL_SCANCODE_F] = K_E;
+	km->keys[SDL_SCANCODE_Z] = K_A;
+	km->keys[SDL_SCANCODE_X] = K_0;
+	km->keys[SDL_SCANCODE_C] = K_B;
+	km->keys[SDL_SCANCODE_V] = K_F;
+}
+
+bool load_keymap(keymap *km, const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		printf("Couldn't open keymap \"%s\".\n", filename);
+		return false;
+	}
+
+	bool success = true;
+	char line[128];
+	uint32_t line_number = 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		++line_number;
+
+		char name[64];
+		unsigned int key;
+		if (line[0] == '#' || sscanf(line, "%63s", name) != 1)
+			continue;
+
+		SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+		if (sscanf(line, "%*s %x", &key) != 1 || key >= 0x10 || scancode == SDL_SCANCODE_UNKNOWN) {
+			printf("\"%s\":%u is not a valid mapping.\n", filename, line_number);
+			success = false;
+			continue;
+		}
+
+		km->keys[scancode] = key;
+	}
+
+	fclose(file);
+	return success;
+}
+
+uint8_t map_key(const keymap *km, SDL_Keysym *keysim) {
+	if (keysim->scancode < 0 || keysim->scancode >= SDL_NUM_SCANCODES)
+		return NO_KEY;
+
+	return km->keys[keysim->scancode];
+}
+
+uint64_t event_arrival(SDL_Event *event) {
+	// SDL only stamps events in milliseconds, so the time spent in the queue is measured
+	// with it and everything after dequeuing with the performance counter.
+	uint64_t now = SDL_GetPerformanceCounter();
+	uint32_t queued_ms = SDL_GetTicks() - event->key.timestamp;
+	uint64_t queued = (uint64_t) queued_ms * SDL_GetPerformanceFrequency() / 1000;
+
+	return (queued < now) ? now - queued : now;
+}
+
+void initialize_latency(latency_stats *ls, const char *export_filename) {
+	memset(ls, 0, sizeof(latency_stats));
+	ls->frequency = SDL_GetPerformanceFrequency();
+
+	if (export_filename) {
+		ls->export = fopen(export_filename, "a");
+		if (ls->export)
+			fprintf(ls->export, "# ms samples p50_us p99_us\n");
+		else
+			printf("Couldn't open \"%s\" to export latencies.\n", export_filename);
+	}
+}
+
+void latency_input(latency_stats *ls, uint64_t arrival) {
+	// Inputs up to the last one recorded were already presented, by an earlier frame that carried them too.
+	if (arrival <= ls->recorded)
+		return;
+
+	// Only the oldest input matters, the ones after it are presented in the same frame.
+	if (ls->pending == 0 || arrival < ls->pending)
+		ls->pending = arrival;
+}
+
+void latency_frame(latency_stats *ls) {
+	if (ls->pending != 0) {
+		uint64_t elapsed_us = (SDL_GetPerformanceCounter() - ls->pending) * 1000000 / ls->frequency;
+		uint64_t bucket = elapsed_us / LATENCY_BUCKET_US;
+
+		++ls->buckets[(bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1];
+		++ls->samples;
+		ls->recorded = ls->pending;
+		ls->pending = 0;
+	}
+
+	if (ls->export) {
+		uint32_t now = SDL_GetTicks();
+		if (now - ls->last_export >= LATENCY_EXPORT_MS) {
+			fprintf(ls->export, "%u %u %u %u\n", now, ls->samples, latency_percentile(ls, 0.5), latency_percentile(ls, 0.99));
+			fflush(ls->export);
+			ls->last_export = now;
+		}
+	}
+}
+
+uint32_t latency_percentile(latency_stats *ls, double fraction) {
+	if (ls->samples == 0)
+		return 0;
+
+	uint32_t target = fraction * ls->samples, seen = 0;
+	for (uint32_t u = 0; u < LATENCY_BUCKETS; ++u) {
+		seen += ls->buckets[u];
+		if (seen > target)
+			return u * LATENCY_BUCKET_US + LATENCY_BUCKET_US / 2;
+	}
+
+	return LATENCY_BUCKETS * LATENCY_BUCKET_US;
+}
+
+void print_latency(latency_stats *ls) {
+	printf(
+		"Input latency over %u samples: p50 %uus p99 %uus\n",
+		ls->samples, latency_percentile(ls, 0.5), latency_percentile(ls, 0.99)
+	);
+}
+
+void destroy_latency(latency_stats *ls) {
+	if (ls->export) {
+		fclose(ls->export);
+		ls->export = NULL;
+	}
+}
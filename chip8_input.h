@@ -0,0 +1,55 @@
+#ifndef __CHIP8_INPUT_H__
+#define __CHIP8_INPUT_H__
+
+#include "chip8.h"
+#include "SDL2/SDL.h"
+#include <stdio.h>
+
+// Returned by map_key when the SDL key has no chip8 keyboard equivalent.
+#define NO_KEY 0x10
+
+// Latencies are kept in a histogram of LATENCY_BUCKET_US wide buckets.
+// Anything slower than the last bucket is counted in it.
+#define LATENCY_BUCKET_US 100
+#define LATENCY_BUCKETS 10000
+#define LATENCY_EXPORT_MS 1000
+
+// Lookup table from SDL scancodes (physical keys) to chip8 keys.
+typedef struct {
+	uint8_t keys[SDL_NUM_SCANCODES];
+} keymap;
+
+// Input-to-photon latency: from the moment a key event arrives until the first
+// render presenting a frame after it was given to the chip8.
+typedef struct {
+	uint64_t pending;			// Arrival (performance counter) of the oldest input not yet presented. 0 if none.
+	uint64_t recorded;			// Newest arrival already in the buckets, frames may carry it again.
+	uint64_t frequency;			// Performance counter ticks per second.
+	uint32_t buckets[LATENCY_BUCKETS];
+	uint32_t samples;
+	uint32_t last_export;			// SDL_GetTicks of the last line written to export.
+	FILE *export;				// Optional file that receives the percentiles while running.
+} latency_stats;
+
+// Shared by every frontend so they all use the same layout.
+void default_keymap(keymap *km);
+// Reads "<key name> <chip8 key>" lines (key names as in SDL_GetScancodeFromName, chip8 key in hex).
+// Lines starting with # are ignored. Keys not in the file keep their current mapping.
+bool load_keymap(keymap *km, const char *filename);
+// Maps a SDL key to it's respective chip8 keyboard key (or NO_KEY).
+uint8_t map_key(const keymap *km, SDL_Keysym *keysim);
+
+// Performance counter value of when the event arrived in SDL's queue.
+uint64_t event_arrival(SDL_Event *event);
+
+void initialize_latency(latency_stats *ls, const char *export_filename);
+// An input arriving at arrival was given to the chip8.
+void latency_input(latency_stats *ls, uint64_t arrival);
+// A frame was presented, every pending input is now on screen.
+void latency_frame(latency_stats *ls);
+// Latency (in microseconds) below which the given fraction (0.0 - 1.0) of the samples are.
+uint32_t latency_percentile(latency_stats *ls, double fraction);
+void print_latency(latency_stats *ls);
+void destroy_latency(latency_stats *ls);
+
+#endif
@@ -1,16 +1,39 @@
 /* José Guilherme de C. Rodrigues - 03/2020 */
 #include "chip8_interpreter.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
 int main(int argc, char **argv) {
+	const char *keymap_file = NULL;
+	const char *latency_file = NULL;
+	const char *log_filename = NULL;
+	bool vip = false;
+	uint8_t filter = FILTER_NEAREST;
+
+	// Flags can be given anywhere, everything else keeps it's position.
+	int positional = 0;
 	for (int i = 0; i < argc; ++i) {
 		if (strcmp(argv[i], "--help") == 0) {
 			show_help();
 			return 0;
+		} else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc) {
+			keymap_file = argv[++i];
+		} else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+			latency_file = argv[++i];
+		} else if (strcmp(argv[i], "--vip") == 0) {
+			vip = true;
+		} else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+			log_filename = argv[++i];
+		} else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			if (!parse_scale_filter(argv[++i], &filter))
+				fprintf(stderr, "Unknown filter \"%s\", using nearest.\n", argv[i]);
+		} else {
+			argv[positional++] = argv[i];
 		}
 	}
+	argc = positional;
 
 	if (argc >= 2) {
 		program_struct ps;
@@ -32,13 +55,17 @@ int main(int argc, char **argv) {
 		}
 		
 		
-		initialize(&ps, argv[1], debug, scale, cycle_ms);
+		initialize(&ps, argv[1], debug, scale, cycle_ms, keymap_file, latency_file, log_filename, vip, filter);
 
-		while (ps.running) {
-			SDL_Delay(ps.cycle_ms);
-			update(&ps);
-			if (ps.chip->status.need_redraw)
-				render(&ps);
+		// Emulation runs on it's own thread, this one only handles events and presents frames.
+		while (ps.running && SDL_WaitEvent(&ps.event)) {
+			do {
+				process_event(&ps);
+			} while (SDL_PollEvent(&ps.event));
+
+			display_frame *frame = triple_buffer_acquire(&ps.frames);
+			if (frame)
+				render(&ps, frame);
 		}
 
 		destroy(&ps);
@@ -49,12 +76,33 @@ int main(int argc, char **argv) {
 	return 0;
 }
 
-void initialize(program_struct *ps, const char* program, bool debug, uint8_t scale, uint32_t cycle_ms) {
+void initialize(program_struct *ps, const char* program, bool debug, uint8_t scale, uint32_t cycle_ms, const char *keymap_file, const char *latency_file, const char *log_filename, bool vip, uint8_t filter) {
 	ps->running = false;
 	ps->paused = false;
+	ps->emulation_thread = NULL;
+	ps->chip = NULL;
+	ps->texture = NULL;
+	ps->scale = scale;
+	ps->filter = filter;
+
+	// Debug output is formatted and written by the log's own thread.
+	ps->log_file = NULL;
+	if (log_filename && !(ps->log_file = fopen(log_filename, "wb")))
+		fprintf(stderr, "Couldn't open \"%s\", logging to the console.\n", log_filename);
+	log_start(ps->log_file ? ps->log_file : stdout, ps->log_file != NULL);
 
 	SDL_Init(SDL_INIT_VIDEO);
 
+	default_keymap(&ps->keymap);
+	if (keymap_file && !load_keymap(&ps->keymap, keymap_file))
+		INTERPRETER_LOG("Some keys of \"%s\" were ignored.\n", keymap_file);
+
+	initialize_latency(&ps->latency, latency_file);
+	triple_buffer_init(&ps->frames);
+	input_queue_init(&ps->input);
+	ps->frame_event_pending = false;
+	ps->input_arrival = 0;
+
 	// Window size
 	const uint16_t window_width = DISPLAY_WIDTH * scale;
 	const uint16_t window_height = DISPLAY_HEIGHT * scale;
@@ -72,168 +120,251 @@ void initialize(program_struct *ps, const char* program, bool debug, uint8_t sca
 	if (ps->window) {
 		ps->renderer = SDL_CreateRenderer(ps->window, -1, 0);
 
-		// If renderer successfully created.
-		if (ps->renderer) {
-			// Set the size of the pixel_rect.
-			ps->pixel_rect.w = scale;
-			ps->pixel_rect.h = scale;
+		// The whole window is a single texture, filled by scale_display.
+		if (ps->renderer)
+			ps->texture = SDL_CreateTexture(ps->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, window_width, window_height);
 
+		// If renderer and texture successfully created.
+		if (ps->texture) {
 			ps->chip = create_chip8(debug);
 			if (load_program(ps->chip, program)) {
 				ps->running = true;
 				ps->cycle_ms = cycle_ms;
+				ps->vip = vip;
+				ps->frame_remainder = 0;
+				vip_timing_init(&ps->timing, true);
+				ps->next_cycle = SDL_GetTicks() + cycle_length(ps);
+
+				ps->emulation_thread = SDL_CreateThread(&emulate, "chip8", ps);
+				if (!ps->emulation_thread) {
+					fprintf(stderr, "An error occurred when creating the emulation thread. %s\n", SDL_GetError());
+					ps->running = false;
+				}
 			}
 		} else {
-			fprintf(stderr, "An error occurred when creating the renderer. %s\n", SDL_GetError());
+			fprintf(stderr, "An error occurred when creating the renderer or it's texture. %s\n", SDL_GetError());
 		}
 	} else {
 		fprintf(stderr, "An error occurred when creating the Window. %s\n", SDL_GetError());
 	}
 }
 
-void update(program_struct *ps) {
-	// Process SDL events.
-	while (SDL_PollEvent(&ps->event)) {
-		if (ps->event.type == SDL_QUIT) {
-			ps->running = false;
-		} else if (ps->event.type == SDL_KEYDOWN) { // Key down event.
-			process_interpreter_key_event(ps, &ps->event.key.keysym);
-			process_key_event(ps, &ps->event.key.keysym, true);
-		} else if (ps->event.type == SDL_KEYUP) { // Key up event.
-			// The key should not be active in chip8.
-			process_key_event(ps, &ps->event.key.keysym, false);
+// Runs on the emulation thread, which owns the chip8 and everything about it's timing.
+int emulate(void *data) {
+	program_struct *ps = data;
+
+	while (ps->running) {
+		wait_for_next_cycle(ps);
+		update(ps);
+	}
+
+	return 0;
+}
+
+// Sleeps until the next cycle is due, but keeps taking input from the queue so it
+// reaches the chip8 without waiting for the rest of cycle_ms.
+void wait_for_next_cycle(program_struct *ps) {
+	int32_t remaining = ps->next_cycle - SDL_GetTicks();
+	while (ps->running && remaining > 0) {
+		process_input_queue(ps);
+		SDL_Delay(1);
+		remaining = ps->next_cycle - SDL_GetTicks();
+	}
+
+	// Don't try to catch up after falling more than a cycle behind.
+	uint32_t length = cycle_length(ps);
+	if (remaining < -(int32_t) length)
+		ps->next_cycle = SDL_GetTicks();
+	ps->next_cycle += length;
+}
+
+// Milliseconds until the next cycle. With the VIP timing it alternates between 16 and 17 so
+// frames average out to 60 per second.
+uint32_t cycle_length(program_struct *ps) {
+	if (!ps->vip)
+		return ps->cycle_ms;
+
+	ps->frame_remainder += 1000 % 60;
+	if (ps->frame_remainder >= 60) {
+		ps->frame_remainder -= 60;
+		return 1000 / 60 + 1;
+	}
+
+	return 1000 / 60;
+}
+
+void process_event(program_struct *ps) {
+	if (ps->event.type == SDL_QUIT) {
+		ps->running = false;
+	} else if (ps->event.type == SDL_KEYDOWN) { // Key down event.
+		process_interpreter_key_event(ps, &ps->event.key.keysym);
+		process_key_event(ps, &ps->event.key.keysym, true);
+	} else if (ps->event.type == SDL_KEYUP) { // Key up event.
+		// The key should not be active in chip8.
+		process_key_event(ps, &ps->event.key.keysym, false);
+	} else if (ps->event.type == SDL_USEREVENT) {
+		// Sent by the emulation thread when it publishes a frame, it was only to wake us up.
+		ps->frame_event_pending = false;
+	}
+}
+
+// Applies everything the frontend's thread sent since the last call. Only on the emulation thread.
+void process_input_queue(program_struct *ps) {
+	input_event event;
+
+	while (input_queue_pop(&ps->input, &event)) {
+		if (event.type == INPUT_KEY) {
+			if (!ps->paused) {
+				change_key(ps->chip, event.key, event.active);
+
+				// The oldest input goes along with the next frame, to measure when it reaches the screen.
+				if (ps->input_arrival == 0 || event.arrival < ps->input_arrival)
+					ps->input_arrival = event.arrival;
+			}
+		} else if (event.type == INPUT_CYCLE_UP) {
+			INTERPRETER_LOG("Increasing Cycle Ms: {%u}.\n", ++ps->cycle_ms);
+		} else if (event.type == INPUT_CYCLE_DOWN) {
+			if (ps->cycle_ms != 0)
+				INTERPRETER_LOG("Decreasing Cycle Ms: {%u}.\n", --ps->cycle_ms);
+			else
+				INTERPRETER_LOG("Minimum Cycle Ms is 0.\n");
+		} else if (event.type == INPUT_DEBUG) {
+			ps->chip->status.debug = !ps->chip->status.debug;
+			INTERPRETER_LOG("Debug %s.\n", (ps->chip->status.debug) ? "enabled" : "disabled");
+		} else if (event.type == INPUT_PAUSE) {
+			ps->paused = !ps->paused;
+			INTERPRETER_LOG("Pause %s.\n", (ps->paused) ? "enabled" : "disabled");
+		} else if (event.type == INPUT_PRINT_REGISTERS) {
+			print_registers(ps->chip);
+		} else if (event.type == INPUT_PRINT_KEYBOARD) {
+			print_keyboard(ps->chip);
+		} else if (event.type == INPUT_PRINT_MEMORY) {
+			print_memory_in_range(ps->chip, 0x0000, 0xfff);
 		}
 	}
+}
+
+void send_input(program_struct *ps, uint8_t type, uint8_t key, bool active) {
+	input_event event = { type, key, active, (type == INPUT_KEY) ? event_arrival(&ps->event) : 0 };
+	if (!input_queue_push(&ps->input, &event))
+		INTERPRETER_LOG("Input queue is full, an event was lost.\n");
+}
 
-	if (!ps->paused) {
-		// Simulates a chip8 cycle.
-		tick(ps->chip);
+void update(program_struct *ps) {
+	process_input_queue(ps);
+
+	// A program waiting for a keystroke doesn't run until the key arrives through the queue.
+	// (Must be done if using chip8.h)
+	if (!ps->paused && !ps->chip->status.need_keystroke) {
+		// Simulates a chip8 cycle (or a whole frame with the VIP's timing).
+		if (ps->vip)
+			vip_run_frame(ps->chip, &ps->timing);
+		else
+			tick(ps->chip);
 
-		// Will wait for a keystroke if the chip8 status need_keystroke is set. (Must be done if using chip8.h)
-		wait_for_keystroke(ps);
+		if (ps->chip->status.fault) {
+			INTERPRETER_LOG("The program stopped with fault %u (PC: 0x%X, I: 0x%X, SP: %u).\n",
+				ps->chip->status.fault, ps->chip->regs.pc, ps->chip->regs.i, ps->chip->regs.sp);
+			ps->paused = true;
+		}
 
 		if (ps->chip->status.need_sound) {
 			// TODO: Play a sound.
 			ps->chip->status.need_sound = false;
 		}
+
+		if (ps->chip->status.need_redraw)
+			publish_frame(ps);
 	}
 }
 
-void render(program_struct *ps) {
-	// Clear the screen with the black color.
-	SDL_SetRenderDrawColor(ps->renderer, 0x0, 0x0, 0x0, 0xFF);
-	SDL_RenderClear(ps->renderer);
-
-	// Set the color to white to render the active pixels.
-	SDL_SetRenderDrawColor(ps->renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-	for (uint8_t y = 0; y < DISPLAY_HEIGHT; ++y) {
-		for (uint8_t x = 0; x < DISPLAY_WIDTH; ++x) {
-			if (ps->chip->display[y][x]) {
-				ps->pixel_rect.x = x * ps->pixel_rect.w;
-				ps->pixel_rect.y = y * ps->pixel_rect.h;
-				SDL_RenderFillRect(ps->renderer, &ps->pixel_rect);
-			}
-		}	
-	}
+// Copies the display to the triple buffer and wakes the frontend's thread up to present it.
+void publish_frame(program_struct *ps) {
+	display_frame *frame = triple_buffer_back(&ps->frames);
+	memcpy(frame->display, ps->chip->display, sizeof(frame->display));
+	frame->input_arrival = ps->input_arrival;
+	ps->input_arrival = 0;
+
+	// The frame this one replaces may never be presented, its input is shown by this one too.
+	// If the frontend takes it after all, latency_input ignores the arrival the second time.
+	const display_frame *pending = triple_buffer_pending(&ps->frames);
+	if (pending && pending->input_arrival != 0 && (frame->input_arrival == 0 || pending->input_arrival < frame->input_arrival))
+		frame->input_arrival = pending->input_arrival;
+
+	triple_buffer_publish(&ps->frames);
 
-	// Shows the rendered screen.
-	SDL_RenderPresent(ps->renderer);
 	// Disable chip8 need_redraw status. (Should be done if using chip8.h)
 	ps->chip->status.need_redraw = false;
+
+	// One wake up is enough no matter how many frames were published before it's handled.
+	if (!atomic_exchange(&ps->frame_event_pending, true)) {
+		SDL_Event event;
+		memset(&event, 0, sizeof(event));
+		event.type = SDL_USEREVENT;
+		SDL_PushEvent(&event);
+	}
 }
 
-// TODO: Maybe put this functionality inside the event loop in update...
-// This function will wait until a key is pressed before letting the interpreter continue.
-void wait_for_keystroke(program_struct *ps) {
-	if (!ps->paused) {
-		while (ps->running && ps->chip->status.need_keystroke) {
-			while (SDL_PollEvent(&ps->event)) {
-				if (ps->event.type == SDL_QUIT) {
-					ps->running = false;
-				} else if (ps->event.type == SDL_KEYDOWN /*&& ps->event.key.repeat == 0 Don't need to activate key in case it's a repeated signal */) {			
-					process_key_event(ps, &ps->event.key.keysym, true);
-				}
-			}
-		}
+void render(program_struct *ps, display_frame *frame) {
+	// Active pixels are white, the others black. Every pixel of the texture is written, so it's not cleared.
+	void *pixels;
+	int pitch;
+	if (SDL_LockTexture(ps->texture, NULL, &pixels, &pitch) == 0) {
+		scale_display(&frame->display[0][0], ps->filter, ps->scale, 0xFFFFFFFF, 0xFF000000, pixels, pitch);
+		SDL_UnlockTexture(ps->texture);
 	}
+	SDL_RenderCopy(ps->renderer, ps->texture, NULL, NULL);
+
+	// Shows the rendered screen.
+	SDL_RenderPresent(ps->renderer);
+	if (frame->input_arrival != 0)
+		latency_input(&ps->latency, frame->input_arrival);
+	latency_frame(&ps->latency);
 }
 
+// Everything that touches the chip8 is sent to the emulation thread.
 void process_interpreter_key_event(program_struct *ps, SDL_Keysym *keysim) {
 	if (ps->event.key.keysym.sym == SDLK_UP) {
-		INTERPRETER_LOG("Increasing Cycle Ms: {%u}.\n", ++ps->cycle_ms);
+		send_input(ps, INPUT_CYCLE_UP, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_DOWN) {
-		if (ps->cycle_ms != 0)
-			INTERPRETER_LOG("Decreasing Cycle Ms: {%u}.\n", --ps->cycle_ms);
-		else
-			INTERPRETER_LOG("Minimum Cycle Ms is 0.\n");
+		send_input(ps, INPUT_CYCLE_DOWN, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_SPACE) {
-		ps->chip->status.debug = !ps->chip->status.debug;
-		INTERPRETER_LOG("Debug %s.\n", (ps->chip->status.debug) ? "enabled" : "disabled");
+		send_input(ps, INPUT_DEBUG, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_p) {
-		ps->paused = !ps->paused;
-		INTERPRETER_LOG("Pause %s.\n", (ps->paused) ? "enabled" : "disabled");
+		send_input(ps, INPUT_PAUSE, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_i) {
-		print_registers(ps->chip);
+		send_input(ps, INPUT_PRINT_REGISTERS, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_k) {
-		print_keyboard(ps->chip);
+		send_input(ps, INPUT_PRINT_KEYBOARD, 0, false);
 	} else if (ps->event.key.keysym.sym == SDLK_m) {
-		print_memory_in_range(ps->chip, 0x0000, 0xfff);
+		send_input(ps, INPUT_PRINT_MEMORY, 0, false);
+	} else if (ps->event.key.keysym.sym == SDLK_l) {
+		print_latency(&ps->latency);
 	}
 }
 
-/*
-			MAPS INTO 
-   CHIP 8 Keyboard	    |	QWERTY Keyboard
-   1	2	3	C   |	1	2	3	4
-   4	5	6	D   |	Q	W	E	R
-   7	8	9	E   |	A	S	D	F
-   A	0	B	F   | 	Z	X	C	V
-*/
 void process_key_event(program_struct *ps, SDL_Keysym *keysim, bool value) {
-	if (!ps->paused) {
-		uint8_t key = 0x10;
-
-		// Maps each key to it's respective chip8 keyboard key.
-		if (keysim->sym == SDLK_1)
-			key = K_1;
-		else if (keysim->sym == SDLK_2)
-			key = K_2;
-		else if (keysim->sym == SDLK_3)
-			key = K_3;
-		else if (keysim->sym == SDLK_4)
-			key = K_C;
-		else if (keysim->sym == SDLK_q)
-			key = K_4;
-		else if (keysim->sym == SDLK_w)
-			key = K_5;
-		else if (keysim->sym == SDLK_e)
-			key = K_6;
-		else if (keysim->sym == SDLK_r)
-			key = K_D;
-		else if (keysim->sym == SDLK_a)
-			key = K_7;
-		else if (keysim->sym == SDLK_s)
-			key = K_8;
-		else if (keysim->sym == SDLK_d)
-			key = K_9;
-		else if (keysim->sym == SDLK_f)
-			key = K_E;
-		else if (keysim->sym == SDLK_z)
-			key = K_A;
-		else if (keysim->sym == SDLK_x)
-			key = K_0;
-		else if (keysim->sym == SDLK_c)
-			key = K_B;
-		else if (keysim->sym == SDLK_v)
-			key = K_F;
-		
-		if (key < 0x10)
-			change_key(ps->chip, key, value);
-	}
+	uint8_t key = map_key(&ps->keymap, keysim);
+	if (key != NO_KEY)
+		send_input(ps, INPUT_KEY, key, value);
 }
 
 void destroy(program_struct *ps) {
+	// The emulation thread has to be done with the chip8 before it goes away.
+	ps->running = false;
+	if (ps->emulation_thread)
+		SDL_WaitThread(ps->emulation_thread, NULL);
+
 	delete_chip8(ps->chip);
+	destroy_latency(&ps->latency);
+
+	log_stop();
+	if (log_dropped() != 0)
+		fprintf(stderr, "%lu log records were dropped.\n", (unsigned long) log_dropped());
+	if (ps->log_file)
+		fclose(ps->log_file);
+	if (ps->texture)
+		SDL_DestroyTexture(ps->texture);
 	SDL_DestroyRenderer(ps->renderer);
 	SDL_DestroyWindow(ps->window);
 	SDL_Quit();
@@ -247,6 +378,11 @@ void show_help() {
 		"scale = int8_t (will scale the dimensions of the original 64x32 chip8 display).\n"
 		"cycle_ms = int32_t (the amount of time the interpreter will sleep between each cycle).\n"
 		"--help will show this message and exit the program.\n"
+		"--keymap <file> remaps the keyboard, each line is \"<key name> <chip8 key in hex>\" (e.g. \"Q 4\").\n"
+		"--vip runs each instruction for as long as it took on the COSMAC VIP, 60 frames per second (cycle_ms is ignored).\n"
+		"--log <file> writes the debug information to a binary file instead of the console (read it with chip8_logdump).\n"
+		"--filter <nearest|epx|scanlines> chooses how the display is scaled (epx needs an even scale).\n"
+		"--latency <file> appends the input latency percentiles (p50/p99) to the file every second.\n"
 		"                        MAPS INTO\n"
    		"CHIP 8 Keyboard             |   QWERTY Keyboard\n"
    		"1	2	3	C   |	1	2	3	4\n"
@@ -261,6 +397,7 @@ void show_help() {
 		"I will print registers state\n"
 		"K will print keyboard state\n"
 		"M will print the whole memory (this might be really big for your console's window)\n"
+		"L will print the input latency percentiles\n"
 		"Made by Jose Guilherme de C. Rodrigues 03/2020."
 	);
 }
\ No newline at end of file
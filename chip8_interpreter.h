@@ -3,25 +3,67 @@
 #define __CHIP8_INTERPRETER_H__
 
 #include "chip8.h"
+#include "chip8_input.h"
+#include "chip8_log.h"
+#include "chip8_timing.h"
+#include "chip8_sync.h"
+#include "chip8_scale.h"
 #include "SDL2/SDL.h"
 
-#define INTERPRETER_LOG(...) printf("[INTERPRETER] " __VA_ARGS__)
+#define INTERPRETER_LOG(...) log_text("[INTERPRETER] " __VA_ARGS__)
+
+// What the frontend's thread sends to the emulation thread.
+typedef enum {
+	INPUT_KEY,
+	INPUT_CYCLE_UP,
+	INPUT_CYCLE_DOWN,
+	INPUT_DEBUG,
+	INPUT_PAUSE,
+	INPUT_PRINT_REGISTERS,
+	INPUT_PRINT_KEYBOARD,
+	INPUT_PRINT_MEMORY
+} input_type;
 
 typedef struct  {
+	// Frontend's thread.
 	SDL_Window *window;
 	SDL_Renderer *renderer;
-	SDL_Rect pixel_rect;
+	SDL_Texture *texture;	// Streaming, the display is scaled into it on the CPU.
+	uint8_t scale;
+	uint8_t filter;		// FILTER_* from chip8_scale.h.
 	SDL_Event event;
-	bool running;
+	keymap keymap;
+	latency_stats latency;
+	FILE *log_file;		// Binary log, NULL when logging as text to stdout.
+
+	// Shared between both threads.
+	atomic_bool running;
+	atomic_bool frame_event_pending;	// A wake up for a new frame is already in SDL's queue.
+	triple_buffer frames;		// Emulation thread writes, frontend's thread presents.
+	input_queue input;		// Frontend's thread sends, emulation thread applies.
+	SDL_Thread *emulation_thread;
+
+	// Emulation thread.
 	bool paused;
 	uint32_t cycle_ms;
+	uint32_t next_cycle;	// SDL_GetTicks of when the next cycle is due.
+	bool vip;		// Runs a VIP frame each cycle instead of a tick, cycles are then 1/60s long.
+	vip_timing timing;
+	uint8_t frame_remainder;	// Milliseconds accumulate as 1000/60 isn't whole.
+	uint64_t input_arrival;		// Oldest input applied since the last published frame.
 	chip8 *chip;
 } program_struct;
 
-void initialize(program_struct *ps, const char* program, bool debug, uint8_t scale, uint32_t cycle_ms);
+void initialize(program_struct *ps, const char* program, bool debug, uint8_t scale, uint32_t cycle_ms, const char *keymap_file, const char *latency_file, const char *log_filename, bool vip, uint8_t filter);
+void wait_for_next_cycle(program_struct *ps);
+uint32_t cycle_length(program_struct *ps);
+int emulate(void *data);
+void process_event(program_struct *ps);
+void process_input_queue(program_struct *ps);
+void send_input(program_struct *ps, uint8_t type, uint8_t key, bool active);
 void update(program_struct *ps);
-void render(program_struct *ps);
-void wait_for_key_stroke(program_struct *ps);
+void publish_frame(program_struct *ps);
+void render(program_struct *ps, display_frame *frame);
 void process_key_event(program_struct *ps, SDL_Keysym *keysim, bool value);
 void process_interpreter_key_event(program_struct *ps, SDL_Keysym *keysim);
 void destroy(program_struct *ps);
@@ -0,0 +1,332 @@
+#include "chip8_log.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Single producer (the owner thread) single consumer (the background thread) ring.
+typedef struct log_ring {
+	log_record records[LOG_RING_SIZE];
+	atomic_size_t head;			// Next record the owner writes.
+	atomic_size_t tail;			// Next record the background thread reads.
+	atomic_uint_fast64_t dropped;
+	uint64_t reported;			// Dropped records already written out.
+	atomic_bool abandoned;			// The owner thread exited, the next thread that logs takes it over.
+	struct log_ring *next;
+} log_ring;
+
+static struct {
+	_Atomic(log_ring *) rings;		// Every thread that ever logged has one here, rings are reused but never freed.
+	atomic_bool running;
+	atomic_uint_fast64_t now;		// Refreshed by the background thread on every pass, stamps the records.
+	pthread_once_t key_once;
+	pthread_key_t key;			// Only there for the destructor, that gives the ring up on thread exit.
+	bool has_key;
+	pthread_t thread;
+	FILE *output;
+	bool binary;
+} logger = { .key_once = PTHREAD_ONCE_INIT };
+
+static _Thread_local log_ring *thread_ring = NULL;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void abandon_ring(void *ring) {
+	// Records still in it are drained as usual, the producer side is free for another thread.
+	atomic_store_explicit(&((log_ring *) ring)->abandoned, true, memory_order_release);
+}
+
+static void create_key() {
+	logger.has_key = pthread_key_create(&logger.key, &abandon_ring) == 0;
+}
+
+static log_ring *get_thread_ring() {
+	if (thread_ring)
+		return thread_ring;
+
+	pthread_once(&logger.key_once, &create_key);
+
+	// Threads that come and go take over the rings of those that are gone, so there are only ever
+	// as many rings as threads logging at the same time.
+	log_ring *ring = atomic_load(&logger.rings);
+	for (; ring; ring = ring->next) {
+		bool abandoned = true;
+		if (atomic_load_explicit(&ring->abandoned, memory_order_relaxed) &&
+				atomic_compare_exchange_strong_explicit(&ring->abandoned, &abandoned, false, memory_order_acquire, memory_order_relaxed))
+			break;
+	}
+
+	if (!ring) {
+		if (!(ring = calloc(1, sizeof(log_ring))))
+			return NULL;
+
+		// Lock free push to the front of the list, the background thread only ever walks it.
+		ring->next = atomic_load(&logger.rings);
+		while (!atomic_compare_exchange_weak(&logger.rings, &ring->next, ring))
+			;
+	}
+
+	// Without the key the ring can't be given up, it's simply kept like before.
+	if (logger.has_key)
+		pthread_setspecific(logger.key, ring);
+	thread_ring = ring;
+
+	return ring;
+}
+
+// Read in the hot path instead of calling clock_gettime for every record.
+static uint64_t coarse_ns() {
+	return atomic_load_explicit(&logger.now, memory_order_relaxed);
+}
+
+// Pushes the record to this thread's ring, or prints it right away if the logger isn't running.
+static void emit(const log_record *record) {
+	if (!atomic_load_explicit(&logger.running, memory_order_relaxed)) {
+		format_record(stdout, record);
+		return;
+	}
+
+	log_ring *ring = get_thread_ring();
+	if (!ring)
+		return;
+
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail == LOG_RING_SIZE) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	ring->records[head & (LOG_RING_SIZE - 1)] = *record;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void write_record(const log_record *record) {
+	if (logger.binary)
+		fwrite(record, sizeof(log_record), 1, logger.output);
+	else
+		format_record(logger.output, record);
+}
+
+// Writes out everything pushed so far. Returns how many records there were.
+static size_t drain() {
+	size_t drained = 0;
+
+	for (log_ring *ring = atomic_load(&logger.rings); ring; ring = ring->next) {
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		for (; tail != head; ++tail, ++drained)
+			write_record(&ring->records[tail & (LOG_RING_SIZE - 1)]);
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+		uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+		if (dropped != ring->reported) {
+			log_record record = { now_ns(), LOG_DROPPED, 0, 0, 0, {0} };
+			record.address = (dropped - ring->reported) >> 16;
+			record.opcode = (dropped - ring->reported) & 0xFFFF;
+			write_record(&record);
+			ring->reported = dropped;
+		}
+	}
+
+	return drained;
+}
+
+static void *log_thread_main(void *arg) {
+	(void) arg;
+	const struct timespec idle = { 0, 1000000 };
+
+	while (atomic_load(&logger.running)) {
+		atomic_store_explicit(&logger.now, now_ns(), memory_order_relaxed);
+		if (drain() == 0) {
+			fflush(logger.output);
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	// Whatever was pushed before log_stop.
+	drain();
+	fflush(logger.output);
+
+	return NULL;
+}
+
+bool log_start(FILE *output, bool binary) {
+	if (atomic_load(&logger.running))
+		return false;
+
+	logger.output = output;
+	logger.binary = binary;
+
+	if (binary) {
+		log_header header = { LOG_MAGIC, LOG_VERSION, sizeof(log_record) };
+		fwrite(&header, sizeof(header), 1, output);
+	}
+
+	atomic_store(&logger.now, now_ns());
+	atomic_store(&logger.running, true);
+	if (pthread_create(&logger.thread, NULL, &log_thread_main, NULL) != 0) {
+		atomic_store(&logger.running, false);
+		return false;
+	}
+
+	return true;
+}
+
+void log_stop() {
+	if (atomic_exchange(&logger.running, false))
+		pthread_join(logger.thread, NULL);
+}
+
+uint64_t log_dropped() {
+	uint64_t dropped = 0;
+	for (log_ring *ring = atomic_load(&logger.rings); ring; ring = ring->next)
+		dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+
+	return dropped;
+}
+
+void log_instruction(uint16_t pc, uint16_t opcode) {
+	log_record record = { coarse_ns(), LOG_INSTRUCTION, pc, opcode, 0, {0} };
+	emit(&record);
+}
+
+void log_registers(const chip8_regs *regs) {
+	log_record record = { coarse_ns(), LOG_REGISTERS, regs->pc, 0, 23, {0} };
+
+	// Packed by hand, so binary logs don't depend on the struct's padding.
+	memcpy(record.data, regs->v, sizeof(regs->v));
+	record.data[16] = regs->i >> 8;
+	record.data[17] = regs->i & 0xFF;
+	record.data[18] = regs->sound_timer;
+	record.data[19] = regs->delay_timer;
+	record.data[20] = regs->pc >> 8;
+	record.data[21] = regs->pc & 0xFF;
+	record.data[22] = regs->sp;
+
+	emit(&record);
+}
+
+void log_memory(uint16_t address, const uint8_t *memory, uint16_t length) {
+	log_record record = { coarse_ns(), LOG_MEMORY, address, 0, length, {0} };
+	if (length > LOG_DATA_SIZE)
+		record.length = LOG_DATA_SIZE;
+
+	memcpy(record.data, memory, record.length);
+	emit(&record);
+}
+
+void log_keyboard(const bool *keyboard) {
+	log_record record = { coarse_ns(), LOG_KEYBOARD, 0, 0, 0x10, {0} };
+	for (uint8_t u = 0; u < 0x10; ++u)
+		record.data[u] = keyboard[u];
+
+	emit(&record);
+}
+
+void log_text(const char *format, ...) {
+	char text[256];
+	va_list args;
+
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (length < 0)
+		return;
+	if (length >= (int) sizeof(text))
+		length = sizeof(text) - 1;
+
+	if (!atomic_load_explicit(&logger.running, memory_order_relaxed)) {
+		fputs(text, stdout);
+		return;
+	}
+
+	// Longer messages are split over consecutive records, they stay in order in the ring.
+	uint64_t timestamp = coarse_ns();
+	for (int offset = 0; offset < length; offset += LOG_DATA_SIZE) {
+		log_record record = { timestamp, LOG_TEXT, 0, 0, 0, {0} };
+		record.length = (length - offset < LOG_DATA_SIZE) ? length - offset : LOG_DATA_SIZE;
+		memcpy(record.data, text + offset, record.length);
+		emit(&record);
+	}
+}
+
+void format_record(FILE *output, const log_record *record) {
+	static char keys[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+	if (record->type == LOG_INSTRUCTION) {
+		fprintf(output, "[CHIP8 - DEBUG] %s 0x%X\n", instruction_name(record->opcode), record->opcode);
+	} else if (record->type == LOG_REGISTERS) {
+		for (uint8_t u = 0; u < 0x10; ++u) {
+			if (u % 8 == 0)
+				fprintf(output, "\n");
+
+			fprintf(output, "V[%u]: 0x%X ", u, record->data[u]);
+		}
+
+		fprintf(
+			output,
+			"\nI: 0x%X"
+			"\tSoundTimer: %u"
+			"\tDelayTimer: %u"
+			"\tPC: %u"
+			"\tSP: %u\n",
+			record->data[16] << 8 | record->data[17], record->data[18], record->data[19],
+			record->data[20] << 8 | record->data[21], record->data[22]
+		);
+	} else if (record->type == LOG_MEMORY) {
+		for (uint16_t u = 0; u < record->length && u < LOG_DATA_SIZE; ++u) {
+			uint16_t address = record->address + u;
+			if (address % 8 == 0)
+				fprintf(output, "\n[%u/0x%X]", address, address);
+
+			fprintf(output, "\t0x%X", record->data[u]);
+		}
+	} else if (record->type == LOG_KEYBOARD) {
+		for (uint8_t u = 0; u < 0x10; ++u)
+			fprintf(output, "[%c]: %u ", keys[u], record->data[u]);
+		fprintf(output, "\n");
+	} else if (record->type == LOG_TEXT) {
+		fwrite(record->data, sizeof(char), (record->length < LOG_DATA_SIZE) ? record->length : LOG_DATA_SIZE, output);
+	} else if (record->type == LOG_DROPPED) {
+		fprintf(output, "[LOG] %lu records dropped.\n", (unsigned long) ((uint32_t) record->address << 16 | record->opcode));
+	}
+}
+
+const char *instruction_name(uint16_t opcode) {
+	static const char *names_8xy[0x10] = {
+		"ld_vx_vy", "or_vx_vy", "and_vx_vy", "xor_vx_vy", "add_vx_vy", "sub_vx_vy", "shr_vx_vy", "subn_vx_vy",
+		NULL, NULL, NULL, NULL, NULL, NULL, "shl_vx_vy", NULL
+	};
+	static const char *names[0x10] = {
+		NULL, "jp_addr", "call_addr", "se_vx_byte", "sne_vx_byte", "se_vx_vy", "ld_vx_byte", "add_vx_byte",
+		NULL, "sne_vx_vy", "ld_i_addr", "jp_v0_addr", "rnd_vx_byte", "drw_vx_vy_nibble", NULL, NULL
+	};
+
+	static const char *names_fx[0x100] = {
+		[0x07] = "ld_vx_dt", [0x0A] = "ld_vx_k", [0x15] = "ld_dt_vx", [0x18] = "ld_st_vx", [0x1E] = "add_i_vx",
+		[0x29] = "ld_f_vx", [0x33] = "ld_b_vx", [0x55] = "ld_at_i_vx", [0x65] = "ld_vx_at_i"
+	};
+
+	// Same groups as decode_instruction.
+	const char *name = names[HB_HN(opcode)];
+	uint8_t hb_hn = HB_HN(opcode), lb = LB(opcode);
+	if (hb_hn == 0x0)
+		name = (lb == 0xE0) ? "cls" : (lb == 0xEE) ? "ret" : NULL;
+	else if (hb_hn == 0x8)
+		name = names_8xy[LB_LN(opcode)];
+	else if (hb_hn == 0xE)
+		name = (lb == 0x9E) ? "skp_vx" : (lb == 0xA1) ? "sknp_vx" : NULL;
+	else if (hb_hn == 0xF)
+		name = names_fx[lb];
+
+	return name ? name : "unknown";
+}
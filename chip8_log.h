@@ -0,0 +1,57 @@
+#ifndef __CHIP8_LOG_H__
+#define __CHIP8_LOG_H__
+
+#include "chip8.h"
+#include <stdio.h>
+
+// Logging without formatting in the hot path. Each thread pushes fixed size records to it's own
+// lock free ring, and a background thread formats them (or writes them as they are, to be read
+// later by chip8_logdump). When a ring is full the record is dropped and counted. A thread's ring
+// is handed to the next thread that logs once it exits.
+// Until log_start is called, everything is printed right away like before.
+
+#define LOG_MAGIC "C8LOG"
+#define LOG_VERSION 1
+#define LOG_RING_SIZE 4096		// Records per thread, must be a power of two.
+#define LOG_DATA_SIZE 32
+
+typedef enum {
+	LOG_INSTRUCTION = 1,	// pc and opcode of an executed instruction.
+	LOG_REGISTERS,		// Packed registers in data.
+	LOG_MEMORY,		// length bytes of memory starting at address.
+	LOG_KEYBOARD,		// 16 key states in data.
+	LOG_TEXT,		// A piece of an already formatted message.
+	LOG_DROPPED		// address and opcode hold how many records were dropped (high and low 16 bits).
+} log_type;
+
+typedef struct {
+	uint64_t timestamp;		// Nanoseconds, monotonic, as of the background thread's last pass (about 1 ms coarse).
+	uint16_t type;
+	uint16_t address;
+	uint16_t opcode;
+	uint16_t length;
+	uint8_t data[LOG_DATA_SIZE];
+} log_record;
+
+// Written once at the start of binary logs.
+typedef struct {
+	char magic[6];
+	uint16_t version;
+	uint32_t record_size;
+} log_header;
+
+bool log_start(FILE *output, bool binary);
+void log_stop();
+uint64_t log_dropped();
+
+void log_instruction(uint16_t pc, uint16_t opcode);
+void log_registers(const chip8_regs *regs);
+void log_memory(uint16_t address, const uint8_t *memory, uint16_t length);
+void log_keyboard(const bool *keyboard);
+void log_text(const char *format, ...);
+
+// Used by the background thread and by the offline decoder.
+void format_record(FILE *output, const log_record *record);
+const char *instruction_name(uint16_t opcode);
+
+#endif
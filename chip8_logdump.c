@@ -0,0 +1,36 @@
+/* Offline decoder for the binary logs written with chip8_interpreter --log. */
+#include "chip8_log.h"
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+	if (argc != 2 || strcmp(argv[1], "--help") == 0) {
+		puts(
+			"chip8_logdump log.bin\n"
+			"Prints a binary log the same way chip8_interpreter would have printed it to the console.\n"
+			"--help will show this message and exit the program."
+		);
+		return 0;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (!file) {
+		fprintf(stderr, "Couldn't open \"%s\".\n", argv[1]);
+		return 1;
+	}
+
+	log_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0
+		|| header.version != LOG_VERSION || header.record_size != sizeof(log_record)) {
+		fprintf(stderr, "\"%s\" is not a chip8 log (or was written by another version).\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+
+	log_record record;
+	while (fread(&record, sizeof(record), 1, file) == 1)
+		format_record(stdout, &record);
+
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include "chip8_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+static void lock_pool(chip8_pool *pool) {
+	while (atomic_flag_test_and_set_explicit(&pool->lock, memory_order_acquire))
+		;
+}
+
+static void unlock_pool(chip8_pool *pool) {
+	atomic_flag_clear_explicit(&pool->lock, memory_order_release);
+}
+
+static bool allocate_arena(chip8_pool *pool) {
+	size_t size = sizeof(chip8) * pool->capacity;
+
+#ifdef __linux__
+	size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+	void *arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (arena != MAP_FAILED) {
+		pool->kind = ARENA_HUGE_PAGES;
+	} else {
+		// No huge pages reserved, transparent ones are the next best thing.
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED)
+			return false;
+#ifdef MADV_HUGEPAGE
+		madvise(arena, size, MADV_HUGEPAGE);
+#endif
+		pool->kind = ARENA_MAPPED;
+	}
+#elif defined(_WIN32)
+	void *arena = _aligned_malloc(size, CHIP8_ALIGNMENT);
+	pool->kind = ARENA_HEAP;
+#else
+	void *arena = aligned_alloc(CHIP8_ALIGNMENT, size);
+	pool->kind = ARENA_HEAP;
+#endif
+
+	pool->instances = arena;
+	pool->arena_size = size;
+	return arena != NULL;
+}
+
+bool pool_init(chip8_pool *pool, uint32_t capacity) {
+	memset(pool, 0, sizeof(*pool));
+	atomic_flag_clear(&pool->lock);
+	pool->capacity = capacity;
+
+	pool->free = malloc(sizeof(uint32_t) * (capacity ? capacity : 1));
+	if (!pool->free || !allocate_arena(pool)) {
+		free(pool->free);
+		pool->free = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// delete_chip8 calls this instead of freeing, the core doesn't know about pools.
+static void release_to_pool(chip8 *chip8) {
+	pool_release(chip8->pool, chip8);
+}
+
+chip8 *pool_acquire(chip8_pool *pool, const chip8 *template) {
+	chip8 *c = NULL;
+	bool warm = false;
+
+	lock_pool(pool);
+	++pool->acquired;
+	if (pool->free_count) {
+		c = &pool->instances[pool->free[--pool->free_count]];
+		warm = true;
+		++pool->reused;
+	} else if (pool->used < pool->capacity) {
+		c = &pool->instances[pool->used++];
+	} else {
+		++pool->overflow;
+	}
+	unlock_pool(pool);
+
+	if (!c) {
+		if ((c = chip8_clone(template)))
+			c->rng = chip8_random_seed();
+		return c;
+	}
+
+	if (!warm) {
+		// Never handed out, chip8_reset copies all of it.
+		c->cache = NULL;
+		c->host = NULL;
+		c->origin = NULL;
+		c->pool = pool;
+		c->release = &release_to_pool;
+	}
+
+	chip8_reset(c, template);
+	// Sessions of the same program would otherwise all draw the same random numbers.
+	c->rng = chip8_random_seed();
+	return c;
+}
+
+void pool_release(chip8_pool *pool, chip8 *chip8) {
+	chip8->cache = NULL;
+	chip8->host = NULL;
+
+	lock_pool(pool);
+	pool->free[pool->free_count++] = chip8 - pool->instances;
+	unlock_pool(pool);
+}
+
+void pool_destroy(chip8_pool *pool) {
+	if (pool->instances) {
+#ifdef __linux__
+		munmap(pool->instances, pool->arena_size);
+#elif defined(_WIN32)
+		_aligned_free(pool->instances);
+#else
+		free(pool->instances);
+#endif
+	}
+
+	free(pool->free);
+	pool->instances = NULL;
+	pool->free = NULL;
+}
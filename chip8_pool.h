@@ -0,0 +1,49 @@
+#ifndef __CHIP8_POOL_H__
+#define __CHIP8_POOL_H__
+
+#include "chip8.h"
+#include <stdatomic.h>
+
+// Fixed arena of instances for programs that start and end many of them (like chip8_sessions).
+// Instances are handed out as copies of a template and go back to the pool when deleted, so churning
+// sessions neither goes through malloc and free nor copies the whole 6 KB state: an instance that was
+// used before is brought back with chip8_reset, which only copies the pages it wrote to.
+//
+// On Linux the arena is mapped on huge pages when there are any reserved (MAP_HUGETLB), or asks for
+// transparent ones otherwise, so thousands of instances don't need thousands of TLB entries.
+// Elsewhere it's a single aligned allocation.
+
+typedef enum {
+	ARENA_HEAP,
+	ARENA_MAPPED,		// mmap, with transparent huge pages if the kernel agrees.
+	ARENA_HUGE_PAGES	// mmap with MAP_HUGETLB.
+} arena_kind;
+
+typedef struct chip8_pool {
+	chip8 *instances;
+	size_t arena_size;
+	uint8_t kind;
+	uint32_t capacity;
+	uint32_t used;			// Instances handed out at least once, the rest of the arena is untouched.
+	uint32_t *free;			// Indices of released instances.
+	uint32_t free_count;
+	atomic_flag lock;		// Only held to push or pop an index.
+
+	// Statistics.
+	uint64_t acquired;
+	uint64_t reused;		// Acquired instances that only had their dirty pages reset.
+	uint64_t overflow;		// Acquired while the arena was full, allocated on their own instead.
+} chip8_pool;
+
+bool pool_init(chip8_pool *pool, uint32_t capacity);
+// A copy of template, taken from the pool. When the arena is full it's a chip8_clone instead.
+// Both are returned with delete_chip8. Safe from any thread.
+// Unlike a clone or a restore it gets it's own random seed (chip8_random_seed), so every session
+// draws different numbers. Use chip8_clone or chip8_reset where the copy must stay deterministic.
+chip8 *pool_acquire(chip8_pool *pool, const chip8 *template);
+// delete_chip8 calls it (through chip8.release) for instances from a pool. The cache and host are let go, not freed.
+void pool_release(chip8_pool *pool, chip8 *chip8);
+// Instances still out must not be used afterwards (those that overflowed are fine).
+void pool_destroy(chip8_pool *pool);
+
+#endif
@@ -0,0 +1,177 @@
+#include "chip8_profile.h"
+#include <stdlib.h>
+
+#define PROFILE_LOG(...) printf("[PROFILE] " __VA_ARGS__)
+
+typedef struct {
+	uint16_t entry;
+	uint64_t self;
+	uint64_t total;
+} profile_routine;
+
+bool profile_init(profile *p) {
+	p->capacity = 64;
+	p->nodes = malloc(sizeof(profile_node) * p->capacity);
+	if (!p->nodes)
+		return false;
+
+	p->nodes[0] = (profile_node) { PROFILE_ROOT, 0, 0, 0, 0, 0 };
+	p->count = 1;
+	p->current = 0;
+	p->instructions = 0;
+	p->samples = 0;
+
+	return true;
+}
+
+void profile_destroy(profile *p) {
+	free(p->nodes);
+	p->nodes = NULL;
+}
+
+// Entry of the routine at level depth of the stack. The return address saved by call_addr is right
+// after the 2nnn that made the call, so the entry can be read back from memory. If it's not a call
+// anymore (the program rewrote it), the call site is used instead.
+static uint16_t call_entry(const chip8 *chip8, uint8_t depth) {
+	uint16_t return_address = chip8->stack[depth];
+	if (return_address < 2 || return_address > sizeof(chip8->memory))
+		return return_address & 0x0FFF;
+
+	uint16_t opcode = chip8->memory[return_address - 2] << 8 | chip8->memory[return_address - 1];
+	return (HB_HN(opcode) == 0x2) ? (opcode & 0x0FFF) : return_address - 2;
+}
+
+// Child of parent for the routine at entry, created if this is the first time it's seen.
+// Falls back to the parent if there's no memory for it.
+static uint32_t child_node(profile *p, uint32_t parent, uint16_t entry) {
+	for (uint32_t c = p->nodes[parent].child; c; c = p->nodes[c].sibling)
+		if (p->nodes[c].entry == entry)
+			return c;
+
+	if (p->count == p->capacity) {
+		profile_node *nodes = realloc(p->nodes, sizeof(profile_node) * p->capacity * 2);
+		if (!nodes)
+			return parent;
+
+		p->nodes = nodes;
+		p->capacity *= 2;
+	}
+
+	uint32_t c = p->count++;
+	p->nodes[c] = (profile_node) { entry, p->nodes[parent].depth + 1, parent, 0, p->nodes[parent].child, 0 };
+	p->nodes[parent].child = c;
+
+	return c;
+}
+
+void profile_instruction(profile *p, const chip8 *chip8) {
+	// At most one call or return happened since the last instruction, but starting in the middle
+	// of a program (or a failed allocation) can leave more levels to catch up with.
+	while (p->nodes[p->current].depth > chip8->regs.sp)
+		p->current = p->nodes[p->current].parent;
+
+	while (p->nodes[p->current].depth < chip8->regs.sp) {
+		uint32_t child = child_node(p, p->current, call_entry(chip8, p->nodes[p->current].depth + 1));
+		if (child == p->current)
+			break;
+		p->current = child;
+	}
+
+	++p->nodes[p->current].self;
+	++p->instructions;
+}
+
+void profile_sample(profile *p, const chip8 *chip8, uint64_t weight) {
+	uint32_t node = 0;
+	for (uint8_t depth = 1; depth <= chip8->regs.sp && depth < 0x10; ++depth)
+		node = child_node(p, node, call_entry(chip8, depth));
+
+	p->nodes[node].self += weight;
+	p->instructions += weight;
+	++p->samples;
+}
+
+// Fills path with the entries from the root to node, returns how many there are.
+static uint8_t node_path(const profile *p, uint32_t node, uint16_t *path) {
+	uint8_t length = p->nodes[node].depth + 1;
+	for (int16_t d = length - 1; d >= 0; --d) {
+		path[d] = p->nodes[node].entry;
+		node = p->nodes[node].parent;
+	}
+
+	return length;
+}
+
+void profile_write_folded(const profile *p, FILE *file) {
+	uint16_t path[0x10];
+
+	for (uint32_t n = 0; n < p->count; ++n) {
+		if (!p->nodes[n].self)
+			continue;
+
+		uint8_t length = node_path(p, n, path);
+		for (uint8_t d = 0; d < length; ++d)
+			fprintf(file, "%s0x%03X", d ? ";" : "", path[d]);
+		fprintf(file, " %llu\n", (unsigned long long) p->nodes[n].self);
+	}
+}
+
+static int compare_routines(const void *a, const void *b) {
+	const profile_routine *ra = a, *rb = b;
+	if (ra->total != rb->total)
+		return (ra->total < rb->total) ? 1 : -1;
+
+	return (ra->self < rb->self) - (ra->self > rb->self);
+}
+
+void profile_print_routines(const profile *p) {
+	profile_routine *routines = calloc(0x1000, sizeof(profile_routine));
+	if (!routines)
+		return;
+
+	uint16_t path[0x10];
+	for (uint32_t n = 0; n < p->count; ++n) {
+		uint64_t self = p->nodes[n].self;
+		if (!self)
+			continue;
+
+		routines[p->nodes[n].entry].self += self;
+
+		// A recursive routine shows up more than once in the path, but only counts once for total.
+		uint8_t length = node_path(p, n, path);
+		for (uint8_t d = 0; d < length; ++d) {
+			bool seen = false;
+			for (uint8_t e = 0; e < d && !seen; ++e)
+				seen = path[e] == path[d];
+
+			if (!seen)
+				routines[path[d]].total += self;
+		}
+	}
+
+	uint16_t used = 0;
+	for (uint16_t u = 0; u < 0x1000; ++u) {
+		if (routines[u].total) {
+			routines[u].entry = u;
+			routines[used++] = routines[u];
+		}
+	}
+	qsort(routines, used, sizeof(profile_routine), &compare_routines);
+
+	double instructions = p->instructions ? (double) p->instructions : 1.0;
+	PROFILE_LOG("%llu instructions", (unsigned long long) p->instructions);
+	if (p->samples)
+		printf(" in %llu samples", (unsigned long long) p->samples);
+	printf(", %u routines.\n", used);
+
+	PROFILE_LOG("Routine\t%20s\t%20s\n", "Self", "Total");
+	for (uint16_t u = 0; u < used; ++u) {
+		PROFILE_LOG(
+			"0x%03X\t%12llu %6.2f%%\t%12llu %6.2f%%\n", routines[u].entry,
+			(unsigned long long) routines[u].self, 100.0 * routines[u].self / instructions,
+			(unsigned long long) routines[u].total, 100.0 * routines[u].total / instructions
+		);
+	}
+
+	free(routines);
+}
@@ -0,0 +1,46 @@
+#ifndef __CHIP8_PROFILE_H__
+#define __CHIP8_PROFILE_H__
+
+#include "chip8.h"
+#include <stdio.h>
+
+// Profiler for the programs being run (not the interpreter). Instructions are attributed to the
+// subroutines on the guest's call stack, identified by their entry address. The stack is kept as a
+// calling context tree: every node is a routine reached through a particular chain of calls.
+//
+// Exact mode calls profile_instruction before every instruction, following call_addr and ret as sp
+// changes. Sampling mode calls profile_sample every so many instructions instead, and rebuilds the
+// stack from the stack array each time, as calls and returns between samples weren't seen.
+
+#define PROFILE_ROOT 0x200	// Entry of the program itself, at the bottom of every stack.
+
+typedef struct {
+	uint16_t entry;		// Address the routine was called at.
+	uint8_t depth;		// Same as sp while this routine runs.
+	uint32_t parent;
+	uint32_t child;		// First child, 0 when there's none (the root is never a child).
+	uint32_t sibling;	// Next child of the same parent.
+	uint64_t self;		// Instructions executed in this routine with exactly this stack.
+} profile_node;
+
+typedef struct {
+	profile_node *nodes;	// Node 0 is the root.
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t current;	// Node of the instruction seen last, only used in exact mode.
+	uint64_t instructions;
+	uint64_t samples;
+} profile;
+
+bool profile_init(profile *p);
+void profile_destroy(profile *p);
+// Exact mode: attributes the instruction about to be executed.
+void profile_instruction(profile *p, const chip8 *chip8);
+// Sampling mode: attributes weight instructions to the current stack.
+void profile_sample(profile *p, const chip8 *chip8, uint64_t weight);
+// One line per stack, "0x200;0x2A4;0x31C count", the input flamegraph.pl and similar tools take.
+void profile_write_folded(const profile *p, FILE *file);
+// Self and total instructions of each routine, by total.
+void profile_print_routines(const profile *p);
+
+#endif
@@ -0,0 +1,129 @@
+#include "chip8_scale.h"
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define EPX_WIDTH (DISPLAY_WIDTH * 2)
+#define EPX_HEIGHT (DISPLAY_HEIGHT * 2)
+
+bool parse_scale_filter(const char *name, uint8_t *filter) {
+	if (strcmp(name, "nearest") == 0)
+		*filter = FILTER_NEAREST;
+	else if (strcmp(name, "epx") == 0)
+		*filter = FILTER_EPX;
+	else if (strcmp(name, "scanlines") == 0)
+		*filter = FILTER_SCANLINES;
+	else
+		return false;
+
+	return true;
+}
+
+static void fill_pixels(uint32_t *out, uint32_t color, size_t count) {
+#if defined(__AVX2__)
+	__m256i wide = _mm256_set1_epi32(color);
+	for (; count >= 8; count -= 8, out += 8)
+		_mm256_storeu_si256((__m256i *) out, wide);
+#endif
+#if defined(__SSE2__)
+	__m128i narrow = _mm_set1_epi32(color);
+	for (; count >= 4; count -= 4, out += 4)
+		_mm_storeu_si128((__m128i *) out, narrow);
+#endif
+	while (count--)
+		*out++ = color;
+}
+
+// Half the brightness, keeping alpha.
+static uint32_t dim(uint32_t color) {
+	return ((color >> 1) & 0x007F7F7F) | (color & 0xFF000000);
+}
+
+// One row of the source image (width pixels, 0 or not) stretched over width * factor pixels.
+static void expand_row(const uint8_t *source, uint16_t width, uint16_t factor, uint32_t on, uint32_t off, uint32_t *out) {
+	for (uint16_t x = 0; x < width; ++x, out += factor)
+		fill_pixels(out, source[x] ? on : off, factor);
+}
+
+// Nearest neighbour from a width x height image, each source row is built once and then copied.
+// Rows from dim_from (within each source row) on use the dimmed colors.
+static void expand_image(const uint8_t *source, uint16_t width, uint16_t height, uint16_t factor, uint16_t dim_from,
+		uint32_t on, uint32_t off, uint32_t *pixels, size_t pitch) {
+	size_t row_length = (size_t) width * factor * sizeof(uint32_t);
+	uint8_t *out = (uint8_t *) pixels;
+
+	for (uint16_t y = 0; y < height; ++y, source += width) {
+		uint32_t *first = (uint32_t *) out;
+		expand_row(source, width, factor, on, off, first);
+		out += pitch;
+
+		uint16_t r = 1;
+		for (; r < factor && r < dim_from; ++r, out += pitch)
+			memcpy(out, first, row_length);
+
+		if (r < factor) {
+			uint32_t *dimmed = (uint32_t *) out;
+			expand_row(source, width, factor, dim(on), dim(off), dimmed);
+			out += pitch;
+
+			for (++r; r < factor; ++r, out += pitch)
+				memcpy(out, dimmed, row_length);
+		}
+	}
+}
+
+// Scale2x/EPX on the display packed as one bit per pixel, a whole row (64 pixels) at a time.
+// With E the pixel, B above, H below, D on the left and F on the right:
+// E0 = D if D == B, B != F and D != H; E1 = F if B == F, B != D and F != H;
+// E2 = D if D == H, D != B and H != F; E3 = F if H == F, H != D and B != F; E otherwise.
+// Neighbours past the edges are E itself.
+static void epx(const uint8_t *display, uint8_t out[EPX_HEIGHT][EPX_WIDTH]) {
+	uint64_t rows[DISPLAY_HEIGHT];
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; ++y) {
+		rows[y] = 0;
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; ++x)
+			rows[y] |= (uint64_t) (display[y * DISPLAY_WIDTH + x] != 0) << x;
+	}
+
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; ++y) {
+		uint64_t e = rows[y];
+		uint64_t b = rows[y ? y - 1 : y];
+		uint64_t h = rows[(y + 1 < DISPLAY_HEIGHT) ? y + 1 : y];
+		uint64_t d = (e << 1) | (e & 0x1);
+		uint64_t f = (e >> 1) | (e & ((uint64_t) 1 << 63));
+
+		// a ^ b is set where a != b.
+		uint64_t c0 = ~(d ^ b) & (b ^ f) & (d ^ h);
+		uint64_t c1 = ~(b ^ f) & (b ^ d) & (f ^ h);
+		uint64_t c2 = ~(d ^ h) & (d ^ b) & (h ^ f);
+		uint64_t c3 = ~(h ^ f) & (h ^ d) & (b ^ f);
+
+		uint64_t e0 = (c0 & d) | (~c0 & e);
+		uint64_t e1 = (c1 & f) | (~c1 & e);
+		uint64_t e2 = (c2 & d) | (~c2 & e);
+		uint64_t e3 = (c3 & f) | (~c3 & e);
+
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; ++x) {
+			out[y * 2][x * 2] = (e0 >> x) & 0x1;
+			out[y * 2][x * 2 + 1] = (e1 >> x) & 0x1;
+			out[y * 2 + 1][x * 2] = (e2 >> x) & 0x1;
+			out[y * 2 + 1][x * 2 + 1] = (e3 >> x) & 0x1;
+		}
+	}
+}
+
+void scale_display(const uint8_t *display, uint8_t filter, uint16_t scale, uint32_t on, uint32_t off, uint32_t *pixels, size_t pitch) {
+	if (filter == FILTER_EPX && scale >= 2 && scale % 2 == 0) {
+		uint8_t doubled[EPX_HEIGHT][EPX_WIDTH];
+		epx(display, doubled);
+		expand_image(&doubled[0][0], EPX_WIDTH, EPX_HEIGHT, scale / 2, scale, on, off, pixels, pitch);
+	} else if (filter == FILTER_SCANLINES && scale >= 2) {
+		// The bottom third of each row, at least one line.
+		uint16_t dimmed = (scale / 3) ? scale / 3 : 1;
+		expand_image(display, DISPLAY_WIDTH, DISPLAY_HEIGHT, scale, scale - dimmed, on, off, pixels, pitch);
+	} else {
+		expand_image(display, DISPLAY_WIDTH, DISPLAY_HEIGHT, scale, scale, on, off, pixels, pitch);
+	}
+}
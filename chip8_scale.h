@@ -0,0 +1,24 @@
+#ifndef __CHIP8_SCALE_H__
+#define __CHIP8_SCALE_H__
+
+#include "chip8.h"
+
+// Expands the display into 32-bit pixels on the CPU, so frontends only have to copy one texture
+// (or write the buffer somewhere) instead of drawing a rect per pixel. Both colors are taken as given,
+// the only assumption is that alpha is the top byte, which holds for ARGB8888 and for RGBA bytes
+// read as a little endian uint32_t.
+// The fills use AVX2 or SSE2 when the compiler targets them (-mavx2), or plain C otherwise.
+
+typedef enum {
+	FILTER_NEAREST,		// Each pixel becomes a scale x scale square.
+	FILTER_EPX,		// Scale2x/EPX first, rounding the corners of diagonal lines, then nearest. Needs an even scale.
+	FILTER_SCANLINES	// Nearest, with the bottom rows of every display row at half the brightness.
+} scale_filter;
+
+// FILTER_* from the names "nearest", "epx" and "scanlines". Returns false for anything else.
+bool parse_scale_filter(const char *name, uint8_t *filter);
+// display is DISPLAY_HEIGHT rows of DISPLAY_WIDTH pixels, like chip8.display (pass &display[0][0]).
+// Writes (DISPLAY_WIDTH * scale) x (DISPLAY_HEIGHT * scale) pixels, pitch is the length of a row in bytes.
+void scale_display(const uint8_t *display, uint8_t filter, uint16_t scale, uint32_t on, uint32_t off, uint32_t *pixels, size_t pitch);
+
+#endif
@@ -0,0 +1,460 @@
+#include "chip8_scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PRESSED(key) (1u << ((key) + 16))
+#define HELD(key) (1u << (key))
+
+static bool list_push(session_list *list, scheduler_session *session) {
+	if (list->count == list->capacity) {
+		size_t capacity = list->capacity ? list->capacity * 2 : 64;
+		scheduler_session **items = realloc(list->items, sizeof(scheduler_session *) * capacity);
+		if (!items)
+			return false;
+
+		list->items = items;
+		list->capacity = capacity;
+	}
+
+	list->items[list->count++] = session;
+	return true;
+}
+
+static void timer_push(scheduler *s, scheduler_session *session, uint64_t wake_frame) {
+	if (s->timer_count == s->timer_capacity) {
+		size_t capacity = s->timer_capacity ? s->timer_capacity * 2 : 64;
+		timer_entry *timers = realloc(s->timers, sizeof(timer_entry) * capacity);
+		if (!timers) {
+			// Can't park it, it'll just keep running.
+			atomic_store(&session->state, SESSION_READY);
+			list_push(&s->runnable, session);
+			return;
+		}
+
+		s->timers = timers;
+		s->timer_capacity = capacity;
+	}
+
+	size_t u = s->timer_count++;
+	while (u && s->timers[(u - 1) / 2].wake_frame > wake_frame) {
+		s->timers[u] = s->timers[(u - 1) / 2];
+		u = (u - 1) / 2;
+	}
+	s->timers[u] = (timer_entry) { session, wake_frame };
+}
+
+static timer_entry timer_pop(scheduler *s) {
+	timer_entry top = s->timers[0];
+	timer_entry last = s->timers[--s->timer_count];
+
+	size_t u = 0;
+	while (u * 2 + 1 < s->timer_count) {
+		size_t child = u * 2 + 1;
+		if (child + 1 < s->timer_count && s->timers[child + 1].wake_frame < s->timers[child].wake_frame)
+			++child;
+		if (s->timers[child].wake_frame >= last.wake_frame)
+			break;
+
+		s->timers[u] = s->timers[child];
+		u = child;
+	}
+	s->timers[u] = last;
+
+	return top;
+}
+
+// Hands the keys that arrived since the last run to the chip8.
+static void apply_input(scheduler_session *session) {
+	uint32_t input = atomic_fetch_and(&session->input, 0xFFFF);
+	chip8 *chip = session->chip;
+
+	for (uint8_t key = 0; key < 0x10; ++key) {
+		bool held = input & HELD(key);
+		if ((input & PRESSED(key)) && !held) {
+			// Pressed and released before it could run, the press still counts.
+			change_key(chip, key, true);
+			change_key(chip, key, false);
+		} else if (held != chip->keyboard[key] || (input & PRESSED(key))) {
+			change_key(chip, key, held);
+		}
+	}
+}
+
+// Frames the timer poll at the PC of an Fx07 has to wait before it can exit, 0 if it's not one.
+// It must be Fx07; 3xkk; 1nnn with the jump going back to the Fx07, which then only exits once
+// the delay timer is kk.
+static uint8_t timer_poll_frames(const chip8 *chip, uint16_t address) {
+	if (address + 5 >= sizeof(chip->memory))
+		return 0;
+
+	const uint8_t *m = chip->memory + address;
+	uint8_t x = m[0] & 0xF;
+	if ((m[0] & 0xF0) != 0xF0 || m[1] != 0x07 || m[2] != (0x30 | x) || (m[4] & 0xF0) != 0x10)
+		return 0;
+	if ((((m[4] & 0xF) << 8) | m[5]) != address)
+		return 0;
+
+	// Below kk the timer will never get there, but it won't change anything before it reaches 0 either.
+	uint8_t dt = chip->regs.delay_timer, kk = m[3];
+	return (dt >= kk) ? dt - kk : dt;
+}
+
+static void run_session(scheduler *s, scheduler_worker *worker, scheduler_session *session) {
+	chip8 *chip = session->chip;
+	atomic_store_explicit(&session->state, SESSION_RUNNING, memory_order_relaxed);
+	apply_input(session);
+
+	// Frames it spent parked still count for the timers.
+	uint64_t missed = s->frame - session->frame - 1;
+	for (uint64_t u = 0; u < missed && u < 0x100; ++u)
+		update_timers(chip);
+
+	// A loop that comes back to the same Fx07 without changing anything will only
+	// change when the timer does, so the rest of the frame would be wasted.
+	uint16_t poll_address = 0xFFFF;
+	uint64_t poll_hash = 0;
+	bool idle = false;
+
+	uint32_t u = 0;
+	for (; u < s->budget && !chip->status.fault && !chip->status.need_keystroke; ++u) {
+		step(chip);
+
+		if ((chip->opcode & 0xF0FF) == 0xF007) {
+			uint64_t hash = chip8_state_hash(chip);
+			if (chip->regs.pc == poll_address && hash == poll_hash) {
+				idle = true;
+				break;
+			}
+
+			poll_address = chip->regs.pc;
+			poll_hash = hash;
+		}
+	}
+
+	update_timers(chip);
+	chip->status.need_redraw = false;
+	chip->status.need_sound = false;
+	session->frame = s->frame;
+
+	worker->instructions += u;
+	++worker->ran;
+	worker->idle += idle;
+
+	if (chip->status.fault) {
+		atomic_store(&session->state, SESSION_STOPPED);
+	} else if (chip->status.need_keystroke) {
+		atomic_store(&session->state, SESSION_PARKED_KEY);
+
+		// A press may have come in after the keys were applied, and seen the session as running.
+		uint_fast8_t parked = SESSION_PARKED_KEY;
+		if ((atomic_load(&session->input) >> 16) && atomic_compare_exchange_strong(&session->state, &parked, SESSION_READY))
+			list_push(&worker->next, session);
+	} else if (idle && timer_poll_frames(chip, poll_address - 2) > 0) {
+		// It runs again on the frame the timer gets to kk.
+		session->wake_frame = s->frame + 1 + timer_poll_frames(chip, poll_address - 2);
+		atomic_store(&session->state, SESSION_PARKED_TIMER);
+		list_push(&worker->timers, session);
+	} else {
+		atomic_store(&session->state, SESSION_READY);
+		list_push(&worker->next, session);
+	}
+}
+
+static scheduler_session *next_session(scheduler *s, uint32_t id) {
+	scheduler_session *session = deque_pop(&s->workers[id].queue);
+	if (session)
+		return session;
+
+	// Nothing is pushed while a frame runs, so if every deque is empty the frame is done.
+	uint32_t *seed = &s->workers[id].seed;
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	uint32_t start = *seed % s->threads;
+	for (uint32_t u = 0; u < s->threads; ++u) {
+		uint32_t victim = (start + u) % s->threads;
+		if (victim != id && (session = deque_steal(&s->workers[victim].queue)))
+			return session;
+	}
+
+	return NULL;
+}
+
+typedef struct {
+	scheduler *s;
+	uint32_t id;
+} scheduler_thread;
+
+static void *scheduler_thread_main(void *arg) {
+	scheduler_thread *thread = arg;
+	scheduler *s = thread->s;
+	scheduler_worker *worker = &s->workers[thread->id];
+	free(thread);
+
+	// Only goes on once every worker was created, see scheduler_init.
+	pthread_mutex_lock(&s->start_lock);
+	pthread_mutex_unlock(&s->start_lock);
+	if (s->stop)
+		return NULL;
+
+	while (true) {
+		pthread_barrier_wait(&s->barrier);
+		if (s->stop)
+			break;
+
+		scheduler_session *session;
+		while ((session = next_session(s, worker - s->workers)))
+			run_session(s, worker, session);
+
+		pthread_barrier_wait(&s->barrier);
+	}
+
+	return NULL;
+}
+
+// Frees what scheduler_init allocated for the workers. A scheduler without workers is an empty one.
+static void free_workers(scheduler *s) {
+	if (s->workers) {
+		for (uint32_t u = 0; u < s->threads; ++u) {
+			if (s->workers[u].queue.items)
+				deque_destroy(&s->workers[u].queue);
+			free(s->workers[u].next.items);
+			free(s->workers[u].timers.items);
+		}
+	}
+
+	free(s->workers);
+	free(s->thread_ids);
+	s->workers = NULL;
+	s->thread_ids = NULL;
+}
+
+bool scheduler_init(scheduler *s, uint32_t threads, uint32_t budget) {
+	memset(s, 0, sizeof(scheduler));
+	s->threads = threads;
+	s->budget = budget;
+
+	s->workers = calloc(threads, sizeof(scheduler_worker));
+	s->thread_ids = calloc(threads, sizeof(pthread_t));
+	bool ready = s->workers && s->thread_ids;
+	for (uint32_t u = 0; ready && u < threads; ++u) {
+		ready = deque_init(&s->workers[u].queue, 1024);
+		s->workers[u].seed = u * 7919 + 1;
+	}
+
+	if (!ready || pthread_mutex_init(&s->wake_lock, NULL) != 0) {
+		free_workers(s);
+		return false;
+	}
+
+	if (pthread_mutex_init(&s->start_lock, NULL) != 0) {
+		pthread_mutex_destroy(&s->wake_lock);
+		free_workers(s);
+		return false;
+	}
+
+	if (pthread_barrier_init(&s->barrier, NULL, threads + 1) != 0) {
+		pthread_mutex_destroy(&s->start_lock);
+		pthread_mutex_destroy(&s->wake_lock);
+		free_workers(s);
+		return false;
+	}
+
+	// The workers wait for this lock before going near the barrier, which needs all of them.
+	pthread_mutex_lock(&s->start_lock);
+	uint32_t started = 0;
+	for (; started < threads; ++started) {
+		scheduler_thread *thread = malloc(sizeof(scheduler_thread));
+		if (!thread)
+			break;
+
+		thread->s = s;
+		thread->id = started;
+		if (pthread_create(&s->thread_ids[started], NULL, &scheduler_thread_main, thread) != 0) {
+			SCHEDULER_LOG("Couldn't create thread %u.\n", started);
+			free(thread);
+			break;
+		}
+	}
+	s->stop = started != threads;
+	pthread_mutex_unlock(&s->start_lock);
+
+	if (s->stop) {
+		for (uint32_t u = 0; u < started; ++u)
+			pthread_join(s->thread_ids[u], NULL);
+
+		pthread_barrier_destroy(&s->barrier);
+		pthread_mutex_destroy(&s->start_lock);
+		pthread_mutex_destroy(&s->wake_lock);
+		free_workers(s);
+		return false;
+	}
+
+	return true;
+}
+
+scheduler_session *scheduler_add(scheduler *s, chip8 *chip, void *user) {
+	scheduler_session *session = malloc(sizeof(scheduler_session));
+	if (!session)
+		return NULL;
+
+	session->chip = chip;
+	session->user = user;
+	atomic_init(&session->state, SESSION_READY);
+	atomic_init(&session->input, 0);
+	session->frame = s->frame;
+	session->wake_frame = 0;
+	session->home = s->next_home++ % s->threads;
+
+	if (!list_push(&s->sessions, session) || !list_push(&s->runnable, session)) {
+		free(session);
+		return NULL;
+	}
+
+	return session;
+}
+
+void scheduler_remove(scheduler *s, scheduler_session *session) {
+	atomic_store(&session->state, SESSION_REMOVED);
+	s->removed = true;
+}
+
+void scheduler_key(scheduler *s, scheduler_session *session, uint8_t key, bool active) {
+	key &= 0xF;
+	if (active)
+		atomic_fetch_or(&session->input, HELD(key) | PRESSED(key));
+	else
+		atomic_fetch_and(&session->input, ~HELD(key));
+
+	uint_fast8_t parked = SESSION_PARKED_KEY;
+	if (active && atomic_compare_exchange_strong(&session->state, &parked, SESSION_READY)) {
+		pthread_mutex_lock(&s->wake_lock);
+		list_push(&s->woken, session);
+		pthread_mutex_unlock(&s->wake_lock);
+	}
+}
+
+// Drops removed sessions from every list, then frees them. Done between frames, nobody else has them.
+static void purge_removed(scheduler *s) {
+	session_list *lists[] = { &s->runnable, &s->woken };
+	for (uint8_t l = 0; l < sizeof(lists) / sizeof(lists[0]); ++l) {
+		size_t kept = 0;
+		for (size_t u = 0; u < lists[l]->count; ++u)
+			if (atomic_load(&lists[l]->items[u]->state) != SESSION_REMOVED)
+				lists[l]->items[kept++] = lists[l]->items[u];
+		lists[l]->count = kept;
+	}
+
+	// Whatever is left of the heap is pushed back in place, in heap order again.
+	size_t count = s->timer_count;
+	s->timer_count = 0;
+	for (size_t u = 0; u < count; ++u) {
+		timer_entry entry = s->timers[u];
+		if (atomic_load(&entry.session->state) != SESSION_REMOVED)
+			timer_push(s, entry.session, entry.wake_frame);
+	}
+
+	// Every session is in this list exactly once, so it's where they're freed.
+	size_t kept = 0;
+	for (size_t u = 0; u < s->sessions.count; ++u) {
+		scheduler_session *session = s->sessions.items[u];
+		if (atomic_load(&session->state) == SESSION_REMOVED) {
+			delete_chip8(session->chip);
+			free(session);
+		} else {
+			s->sessions.items[kept++] = session;
+		}
+	}
+	s->sessions.count = kept;
+
+	s->removed = false;
+}
+
+void scheduler_frame(scheduler *s) {
+	++s->frame;
+
+	pthread_mutex_lock(&s->wake_lock);
+	for (size_t u = 0; u < s->woken.count; ++u)
+		list_push(&s->runnable, s->woken.items[u]);
+	s->woken.count = 0;
+	if (s->removed)
+		purge_removed(s);
+	pthread_mutex_unlock(&s->wake_lock);
+
+	while (s->timer_count && s->timers[0].wake_frame <= s->frame) {
+		timer_entry entry = timer_pop(s);
+		uint_fast8_t parked = SESSION_PARKED_TIMER;
+		if (entry.session->wake_frame == entry.wake_frame && atomic_compare_exchange_strong(&entry.session->state, &parked, SESSION_READY))
+			list_push(&s->runnable, entry.session);
+	}
+
+	// Sessions go back to the same worker every frame, so they tend to stay in it's cache.
+	// Those that don't fit in a queue stay in runnable, and are run by this thread.
+	size_t kept = 0;
+	for (size_t u = 0; u < s->runnable.count; ++u) {
+		scheduler_session *session = s->runnable.items[u];
+		if (!deque_push(&s->workers[session->home].queue, session))
+			s->runnable.items[kept++] = session;
+	}
+	s->runnable.count = 0;
+	if (kept)
+		SCHEDULER_LOG("%lu sessions didn't fit in the run queues, running them on the calling thread.\n", (unsigned long) kept);
+
+	pthread_barrier_wait(&s->barrier);
+	pthread_barrier_wait(&s->barrier);
+
+	// The workers are waiting for the next frame, their lists are free to use.
+	for (size_t u = 0; u < kept; ++u) {
+		scheduler_session *session = s->runnable.items[u];
+		run_session(s, &s->workers[session->home], session);
+	}
+
+	for (uint32_t w = 0; w < s->threads; ++w) {
+		scheduler_worker *worker = &s->workers[w];
+		for (size_t u = 0; u < worker->next.count; ++u)
+			list_push(&s->runnable, worker->next.items[u]);
+		for (size_t u = 0; u < worker->timers.count; ++u)
+			timer_push(s, worker->timers.items[u], worker->timers.items[u]->wake_frame);
+		worker->next.count = 0;
+		worker->timers.count = 0;
+
+		s->instructions += worker->instructions;
+		s->session_frames += worker->ran;
+		s->idle_frames += worker->idle;
+		worker->instructions = 0;
+		worker->ran = 0;
+		worker->idle = 0;
+	}
+}
+
+void scheduler_count(scheduler *s, size_t *out) {
+	memset(out, 0, sizeof(size_t) * (SESSION_REMOVED + 1));
+	for (size_t u = 0; u < s->sessions.count; ++u)
+		++out[atomic_load(&s->sessions.items[u]->state)];
+}
+
+void scheduler_destroy(scheduler *s) {
+	if (!s->workers)
+		return;
+
+	// Only a fully initialized scheduler has workers, so the threads are all running.
+	s->stop = true;
+	pthread_barrier_wait(&s->barrier);
+	for (uint32_t u = 0; u < s->threads; ++u)
+		pthread_join(s->thread_ids[u], NULL);
+	pthread_barrier_destroy(&s->barrier);
+	pthread_mutex_destroy(&s->start_lock);
+
+	for (size_t u = 0; u < s->sessions.count; ++u) {
+		delete_chip8(s->sessions.items[u]->chip);
+		free(s->sessions.items[u]);
+	}
+
+	free_workers(s);
+	free(s->sessions.items);
+	free(s->runnable.items);
+	free(s->woken.items);
+	free(s->timers);
+	pthread_mutex_destroy(&s->wake_lock);
+	memset(s, 0, sizeof(scheduler));
+}
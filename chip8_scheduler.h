@@ -0,0 +1,104 @@
+#ifndef __CHIP8_SCHEDULER_H__
+#define __CHIP8_SCHEDULER_H__
+
+#include "chip8.h"
+#include "chip8_deque.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define SCHEDULER_LOG(...) printf("[SCHEDULER] " __VA_ARGS__)
+
+// Runs many chip8 instances (sessions) on a fixed pool of threads, one frame at a time.
+// Each frame every runnable session gets a budget of instructions and the timers are updated once,
+// like on the real thing at 60 Hz. Sessions are spread over per worker deques and workers that run
+// out steal from the others.
+//
+// Sessions that can't do anything useful are parked, off the run queues:
+// - Waiting for a key (Fx0A): until scheduler_key presses one.
+// - Polling the delay timer (Fx07; 3xkk; 1nnn jumping back to the Fx07): until the timer reaches kk.
+// Any other loop that spins without changing the state ends it's frame early instead.
+// Timers of parked sessions catch up when they run again.
+
+typedef enum {
+	SESSION_READY = 0,	// In a run queue.
+	SESSION_RUNNING,
+	SESSION_PARKED_KEY,
+	SESSION_PARKED_TIMER,
+	SESSION_STOPPED,	// Faulted, stays out of the run queues. Can still be inspected.
+	SESSION_REMOVED		// Freed at the start of the next frame.
+} session_state;
+
+typedef struct {
+	chip8 *chip;
+	void *user;
+	atomic_uint_fast8_t state;
+	// Low 16 bits are the keys held, the high 16 bits the keys pressed since the session last ran,
+	// so a press and release between two runs still reaches an Fx0A.
+	atomic_uint_fast32_t input;
+	uint64_t frame;		// Last frame the timers were updated for.
+	uint64_t wake_frame;	// When parked on the timer.
+	uint32_t home;		// Worker whose deque the session is pushed to.
+} scheduler_session;
+
+typedef struct {
+	scheduler_session **items;
+	size_t count;
+	size_t capacity;
+} session_list;
+
+typedef struct {
+	scheduler_session *session;
+	uint64_t wake_frame;
+} timer_entry;
+
+typedef struct {
+	work_deque queue;		// Sessions to run this frame.
+	session_list next;		// Sessions that stay runnable for the next frame.
+	session_list timers;		// Sessions parked on the timer during this frame.
+	uint64_t instructions;
+	uint64_t ran;
+	uint64_t idle;			// Frames ended early by a spinning loop.
+	uint32_t seed;			// Picks the victims when stealing.
+} scheduler_worker;
+
+typedef struct {
+	uint32_t threads;
+	uint32_t budget;		// Instructions per session per frame.
+	scheduler_worker *workers;
+	pthread_t *thread_ids;
+	pthread_barrier_t barrier;	// Workers and the thread calling scheduler_frame.
+	pthread_mutex_t start_lock;	// Held by scheduler_init until every worker was created.
+	bool stop;
+	uint64_t frame;
+
+	session_list sessions;		// Every session, including parked ones.
+	session_list runnable;
+	timer_entry *timers;		// Min heap by wake_frame.
+	size_t timer_count;
+	size_t timer_capacity;
+	pthread_mutex_t wake_lock;	// scheduler_key may be called from any thread.
+	session_list woken;
+	uint32_t next_home;
+	bool removed;			// Some session was removed since the last frame.
+
+	// Totals, updated after every frame.
+	uint64_t instructions;
+	uint64_t session_frames;
+	uint64_t idle_frames;
+} scheduler;
+
+bool scheduler_init(scheduler *s, uint32_t threads, uint32_t budget);
+// The scheduler owns chip from now on (it deletes it with delete_chip8, so instances from a pool
+// go back to it). Not thread safe, call it between frames.
+scheduler_session *scheduler_add(scheduler *s, chip8 *chip, void *user);
+// Not thread safe, call it between frames. The session must not be used afterwards.
+void scheduler_remove(scheduler *s, scheduler_session *session);
+// Safe from any thread, at any time. A press wakes a session waiting for a key.
+void scheduler_key(scheduler *s, scheduler_session *session, uint8_t key, bool active);
+// Runs one frame of every runnable session, returns when all of them are done.
+void scheduler_frame(scheduler *s);
+// Sessions in each state, out has one entry per session_state.
+void scheduler_count(scheduler *s, size_t *out);
+void scheduler_destroy(scheduler *s);
+
+#endif
@@ -0,0 +1,181 @@
+/* Runs many sessions of the given programs through the scheduler, pressing random keys,
+ * to see how many a machine can hold. */
+#include "chip8_scheduler.h"
+#include "chip8_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void show_sessions_help() {
+	puts(
+		"chip8_sessions program.ch8 [program.ch8 ...] [--threads N] [--sessions N] [--frames N] [--budget N] [--keys N] [--churn N] [--realtime]\n"
+		"Runs N sessions (the programs take turns) on a pool of threads, one frame at a time, and shows how they were scheduled.\n"
+		"--threads number of worker threads (4 by default).\n"
+		"--sessions number of sessions (1000 by default).\n"
+		"--frames frames to run (600 by default).\n"
+		"--budget instructions each session may run per frame (1000 by default).\n"
+		"--keys sessions that get a random key press every frame (16 by default).\n"
+		"--churn sessions that end and are replaced by a new one every frame (0 by default).\n"
+		"--realtime waits for the next 1/60 s between frames and counts the ones that took longer.\n"
+		"--help will show this message and exit the program."
+	);
+}
+
+int main(int argc, char **argv) {
+	uint32_t threads = 4, sessions = 1000, frames = 600, budget = 1000, keys = 16, churn = 0;
+	bool realtime = false;
+	const char **programs = malloc(sizeof(char *) * argc);
+	int program_count = 0;
+	if (!programs)
+		return 1;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			show_sessions_help();
+			return 0;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+			sessions = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+			budget = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+			keys = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--churn") == 0 && i + 1 < argc) {
+			churn = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--realtime") == 0) {
+			realtime = true;
+		} else {
+			programs[program_count++] = argv[i];
+		}
+	}
+
+	if (program_count == 0 || threads == 0 || sessions == 0) {
+		show_sessions_help();
+		return 0;
+	}
+
+	// Every session starts as a copy of one of these.
+	chip8 **templates = malloc(sizeof(chip8 *) * program_count);
+	if (!templates)
+		return 1;
+	for (int p = 0; p < program_count; ++p) {
+		templates[p] = create_chip8(false);
+		if (!templates[p] || !load_program(templates[p], programs[p]))
+			return 1;
+	}
+
+	// Removed sessions only go back to the pool at the start of the next frame, so churning needs a
+	// frame's worth of extra instances.
+	chip8_pool pool;
+	if (!pool_init(&pool, sessions + churn)) {
+		SCHEDULER_LOG("Couldn't allocate the pool.\n");
+		return 1;
+	}
+
+	scheduler s;
+	scheduler_session **list = malloc(sizeof(scheduler_session *) * sessions);
+	if (!list || !scheduler_init(&s, threads, budget)) {
+		SCHEDULER_LOG("Couldn't start the scheduler.\n");
+		return 1;
+	}
+
+	for (uint32_t u = 0; u < sessions; ++u) {
+		chip8 *chip = pool_acquire(&pool, templates[u % program_count]);
+		if (!chip || !(list[u] = scheduler_add(&s, chip, NULL))) {
+			SCHEDULER_LOG("Only %u sessions fit in memory.\n", u);
+			return 1;
+		}
+	}
+
+	uint32_t seed = 0x2545F491;
+	uint32_t *pressed = calloc(keys ? keys : 1, sizeof(uint32_t));
+	uint32_t late = 0;
+	uint64_t churned = 0;
+	double start = now_seconds(), deadline = start;
+
+	for (uint32_t f = 0; f < frames; ++f) {
+		// Last frame's keys are released, some other sessions get a key.
+		for (uint32_t k = 0; k < keys; ++k) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			if (f)
+				scheduler_key(&s, list[pressed[k] % sessions], pressed[k] / sessions, false);
+			pressed[k] = (seed % sessions) + (seed >> 28) * sessions;
+			scheduler_key(&s, list[pressed[k] % sessions], pressed[k] / sessions, true);
+		}
+
+		// Some sessions end and new ones take their place, released instances are reused from the next frame on.
+		for (uint32_t c = 0; c < churn; ++c) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			uint32_t u = seed % sessions;
+			chip8 *chip = pool_acquire(&pool, templates[(u + f) % program_count]);
+			scheduler_remove(&s, list[u]);
+			if (!chip || !(list[u] = scheduler_add(&s, chip, NULL))) {
+				SCHEDULER_LOG("Couldn't replace a session.\n");
+				return 1;
+			}
+			++churned;
+		}
+
+		scheduler_frame(&s);
+
+		if (realtime) {
+			deadline += 1.0 / 60;
+			double left = deadline - now_seconds();
+			if (left > 0) {
+				struct timespec wait = { (time_t) left, (long) ((left - (time_t) left) * 1e9) };
+				nanosleep(&wait, NULL);
+			} else {
+				++late;
+			}
+		}
+
+		if ((f + 1) % 60 == 0 || f + 1 == frames) {
+			size_t count[SESSION_REMOVED + 1];
+			scheduler_count(&s, count);
+			SCHEDULER_LOG(
+				"Frame %u: %lu ready, %lu waiting for a key, %lu waiting for the timer, %lu stopped.\n", f + 1,
+				(unsigned long) count[SESSION_READY], (unsigned long) count[SESSION_PARKED_KEY],
+				(unsigned long) count[SESSION_PARKED_TIMER], (unsigned long) count[SESSION_STOPPED]
+			);
+		}
+	}
+
+	double seconds = now_seconds() - start;
+	SCHEDULER_LOG(
+		"%u frames of %u sessions in %.2fs (%.0f frames/s), %lu session frames run, %lu ended early.\n",
+		frames, sessions, seconds, frames / seconds, (unsigned long) s.session_frames, (unsigned long) s.idle_frames
+	);
+	SCHEDULER_LOG("%.1f million instructions/s.\n", s.instructions / seconds / 1e6);
+	if (churn)
+		SCHEDULER_LOG(
+			"%lu sessions replaced, %lu instances reused from the pool, %lu allocated outside of it.\n",
+			(unsigned long) churned, (unsigned long) pool.reused, (unsigned long) pool.overflow
+		);
+	if (realtime)
+		SCHEDULER_LOG("%u frames took longer than 1/60 s.\n", late);
+
+	// The scheduler gives it's instances back to the pool, so it goes first.
+	scheduler_destroy(&s);
+	pool_destroy(&pool);
+	for (int p = 0; p < program_count; ++p)
+		delete_chip8(templates[p]);
+	free(templates);
+	free(programs);
+	free(pressed);
+	free(list);
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include "chip8_sync.h"
+#include <string.h>
+
+void triple_buffer_init(triple_buffer *tb) {
+	memset(tb->buffers, 0, sizeof(tb->buffers));
+	tb->back = 0;
+	atomic_init(&tb->middle, 1);
+	tb->front = 2;
+}
+
+display_frame *triple_buffer_back(triple_buffer *tb) {
+	return &tb->buffers[tb->back];
+}
+
+void triple_buffer_publish(triple_buffer *tb) {
+	// Release, so the reader sees everything written to the buffer before it sees the index.
+	unsigned int old = atomic_exchange_explicit(&tb->middle, tb->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+	tb->back = old & 0x3;
+}
+
+const display_frame *triple_buffer_pending(triple_buffer *tb) {
+	// The writer filled every buffer itself, only the index has to be read.
+	unsigned int middle = atomic_load_explicit(&tb->middle, memory_order_relaxed);
+	return (middle & TRIPLE_BUFFER_FRESH) ? &tb->buffers[middle & 0x3] : NULL;
+}
+
+display_frame *triple_buffer_acquire(triple_buffer *tb) {
+	if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH))
+		return NULL;
+
+	unsigned int old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+	tb->front = old & 0x3;
+
+	return &tb->buffers[tb->front];
+}
+
+void input_queue_init(input_queue *queue) {
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+}
+
+bool input_queue_push(input_queue *queue, const input_event *event) {
+	size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&queue->tail, memory_order_acquire) == INPUT_QUEUE_SIZE)
+		return false;
+
+	queue->events[head & (INPUT_QUEUE_SIZE - 1)] = *event;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+bool input_queue_pop(input_queue *queue, input_event *event) {
+	size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	if (tail == atomic_load_explicit(&queue->head, memory_order_acquire))
+		return false;
+
+	*event = queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef __CHIP8_SYNC_H__
+#define __CHIP8_SYNC_H__
+
+#include "chip8.h"
+#include <stdatomic.h>
+
+// Lock free structures used to hand data between the emulation thread and the frontend's thread.
+
+#define INPUT_QUEUE_SIZE 256	// Must be a power of two.
+#define TRIPLE_BUFFER_FRESH 0x4	// Set in middle when it holds a frame the reader hasn't taken yet.
+
+typedef struct {
+	uint8_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+	uint64_t input_arrival;		// Arrival of the oldest input given to the chip8 before this frame. 0 if none.
+} display_frame;
+
+// The writer always has a buffer to write to and the reader always has a complete frame to show,
+// they only ever swap their buffer with the one in the middle.
+typedef struct {
+	display_frame buffers[3];
+	atomic_uint middle;		// Index of the middle buffer, plus TRIPLE_BUFFER_FRESH.
+	uint8_t back;			// Only touched by the writer.
+	uint8_t front;			// Only touched by the reader.
+} triple_buffer;
+
+typedef struct {
+	uint8_t type;			// What it means is up to the frontend.
+	uint8_t key;
+	bool active;
+	uint64_t arrival;
+} input_event;
+
+// Single producer, single consumer queue.
+typedef struct {
+	input_event events[INPUT_QUEUE_SIZE];
+	atomic_size_t head;		// Next event the producer writes.
+	atomic_size_t tail;		// Next event the consumer reads.
+} input_queue;
+
+void triple_buffer_init(triple_buffer *tb);
+// The writer fills this buffer, then publishes it.
+display_frame *triple_buffer_back(triple_buffer *tb);
+void triple_buffer_publish(triple_buffer *tb);
+// For the writer: the published frame the reader hasn't taken yet, or NULL. Publishing replaces it,
+// so it may never be shown. The reader can still take it meanwhile, it's only safe to read.
+const display_frame *triple_buffer_pending(triple_buffer *tb);
+// Latest published frame, or NULL if there's nothing new since the last call.
+display_frame *triple_buffer_acquire(triple_buffer *tb);
+
+void input_queue_init(input_queue *queue);
+bool input_queue_push(input_queue *queue, const input_event *event);
+bool input_queue_pop(input_queue *queue, input_event *event);
+
+#endif
@@ -0,0 +1,109 @@
+#include "chip8_timing.h"
+
+// Execution cost of each instruction group (first nibble) without fetching and decoding.
+// Groups 0x0, 0x8, 0xD, 0xE and 0xF depend on the rest of the opcode (see vip_instruction_cycles).
+static const uint16_t group_cycles[0x10] = {
+	24,	// 0x0 cls / ret
+	12,	// 0x1 jp_addr
+	26,	// 0x2 call_addr
+	10,	// 0x3 se_vx_byte (+4 when skipping)
+	10,	// 0x4 sne_vx_byte (+4 when skipping)
+	14,	// 0x5 se_vx_vy (+4 when skipping)
+	6,	// 0x6 ld_vx_byte
+	10,	// 0x7 add_vx_byte
+	44,	// 0x8 arithmetic, all go through the same self modifying routine
+	14,	// 0x9 sne_vx_vy (+4 when skipping)
+	12,	// 0xA ld_i_addr
+	22,	// 0xB jp_v0_addr
+	36,	// 0xC rnd_vx_byte
+	26,	// 0xD drw_vx_vy_nibble (plus the rows)
+	14,	// 0xE skp_vx / sknp_vx (+4 when skipping)
+	10	// 0xF timers and I
+};
+
+#define SKIP_CYCLES 4
+// Each sprite row costs more when it isn't aligned to a display byte, since it has to be
+// shifted and written to two bytes.
+#define DRW_ALIGNED_ROW_CYCLES 24
+#define DRW_UNALIGNED_ROW_CYCLES 48
+
+void vip_timing_init(vip_timing *timing, bool vblank_wait) {
+	timing->budget = 0;
+	timing->cycles = 0;
+	timing->frames = 0;
+	timing->vblank_wait = vblank_wait;
+}
+
+uint32_t vip_instruction_cycles(chip8 *chip8) {
+	uint16_t opcode = chip8->opcode;
+	uint8_t hb_hn = HB_HN(opcode), lb = LB(opcode);
+	uint8_t vx = chip8->regs.v[HB_LN(opcode)], vy = chip8->regs.v[LB_HN(opcode)];
+	uint32_t cycles = VIP_FETCH_CYCLES + group_cycles[hb_hn];
+
+	if (hb_hn == 0x0) {
+		// Clearing goes through the whole 256 bytes of display memory.
+		if (lb == 0xE0)
+			cycles += 256 * 3;
+	} else if ((hb_hn == 0x3 && vx == lb) || (hb_hn == 0x4 && vx != lb)
+		|| (hb_hn == 0x5 && vx == vy) || (hb_hn == 0x9 && vx != vy)) {
+		cycles += SKIP_CYCLES;
+	} else if (hb_hn == 0xD) {
+		uint8_t rows = LB_LN(opcode);
+		cycles += rows * ((vx % 8 == 0) ? DRW_ALIGNED_ROW_CYCLES : DRW_UNALIGNED_ROW_CYCLES);
+	} else if (hb_hn == 0xE) {
+		bool pressed = check_key(chip8, vx);
+		if ((lb == 0x9E && pressed) || (lb == 0xA1 && !pressed))
+			cycles += SKIP_CYCLES;
+	} else if (hb_hn == 0xF) {
+		uint8_t x = HB_LN(opcode);
+		if (lb == 0x1E) {
+			cycles += 8;
+		} else if (lb == 0x29) {
+			cycles += 10;
+		} else if (lb == 0x33) {
+			// BCD is done by repeated subtraction, so it depends on the digits.
+			cycles += 26 + 12 * (vx / 100 + (vx / 10) % 10 + vx % 10);
+		} else if (lb == 0x55 || lb == 0x65) {
+			// One pass through the copy loop for each register.
+			cycles += 4 + 8 * (x + 1);
+		}
+	}
+
+	return cycles;
+}
+
+uint32_t vip_run_frame(chip8 *chip8, vip_timing *timing) {
+	uint32_t instructions = 0;
+
+	timing->budget += VIP_CYCLES_AVAILABLE;
+	while (timing->budget > 0 && !chip8->status.fault && !chip8->status.need_keystroke) {
+		fetch_instruction(chip8);
+		infn_ptr instruction = decode_instruction(chip8);
+		if (chip8->status.fault)
+			break;
+
+		uint32_t cycles = vip_instruction_cycles(chip8);
+		if (instruction)
+			(*instruction)(chip8);
+
+		timing->budget -= cycles;
+		timing->cycles += cycles;
+		++instructions;
+
+		// The VIP's DRW waits for the display interrupt, the rest of the frame goes by idle.
+		if (timing->vblank_wait && HB_HN(chip8->opcode) == 0xD && timing->budget > 0) {
+			timing->cycles += timing->budget;
+			timing->budget = 0;
+		}
+	}
+
+	// Waiting for a key (or stopped by a fault) doesn't carry cycles over to the next frame.
+	if (timing->budget > 0)
+		timing->budget = 0;
+
+	// The interrupt routine updates the timers once per frame.
+	update_timers(chip8);
+	++timing->frames;
+
+	return instructions;
+}
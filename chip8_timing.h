@@ -0,0 +1,32 @@
+#ifndef __CHIP8_TIMING_H__
+#define __CHIP8_TIMING_H__
+
+#include "chip8.h"
+
+// Timing model of the original interpreter on the COSMAC VIP. Each instruction costs the machine
+// cycles the VIP took to run it, and execution is budgeted per 60 Hz display frame.
+// The costs are approximations taken from published analyses of the VIP interpreter.
+
+// 1.7609 MHz clock, 8 clocks per machine cycle, 60 frames per second.
+#define VIP_CYCLES_PER_FRAME 3668
+// Taken every frame by the display DMA and the interrupt routine (which also updates the timers).
+#define VIP_INTERRUPT_CYCLES 1070
+#define VIP_CYCLES_AVAILABLE (VIP_CYCLES_PER_FRAME - VIP_INTERRUPT_CYCLES)
+// Fetching and decoding, paid by every instruction.
+#define VIP_FETCH_CYCLES 40
+
+typedef struct {
+	int32_t budget;		// Cycles left in the current frame. Negative when an instruction ran into this frame.
+	uint64_t cycles;	// Machine cycles executed so far.
+	uint64_t frames;
+	bool vblank_wait;	// The cycles left in the frame are spent after a DRW, ending the frame there, like the VIP did.
+} vip_timing;
+
+void vip_timing_init(vip_timing *timing, bool vblank_wait);
+// Cost of the instruction in opcode with the current state. Must be called before executing it.
+uint32_t vip_instruction_cycles(chip8 *chip8);
+// Runs the instructions of one 60 Hz frame, then updates the timers once.
+// Returns how many instructions were executed.
+uint32_t vip_run_frame(chip8 *chip8, vip_timing *timing);
+
+#endif